@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <time.h>
+#include <chrono>
+#include <stdint.h>
 
 namespace benchmarking {
     struct Benchmark {
@@ -19,6 +21,31 @@ namespace benchmarking {
             return toreturn;
         }
     };
+    
+    /*
+     wall clock timer, clock() above measures cpu time
+     */
+    struct Timer {
+        std::chrono::steady_clock::time_point start;
+        
+        Timer() : start(std::chrono::steady_clock::now()) { };
+        
+        void reset() {
+            start = std::chrono::steady_clock::now();
+        }
+        
+        int64_t elapsedMicroseconds() const {
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+        
+        int64_t elapsedMilliseconds() const {
+            return elapsedMicroseconds() / 1000;
+        }
+    };
+    
+    inline uint64_t perSecond(uint64_t count, int64_t microseconds) {
+        return microseconds > 0 ? count * 1000000 / microseconds : 0;
+    }
 }
 
 
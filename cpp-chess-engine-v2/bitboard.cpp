@@ -0,0 +1,142 @@
+#include "bitboard.h"
+
+namespace chess {
+    namespace bb {
+
+        Bitboard between[64][64];
+        Bitboard line[64][64];
+
+        Magic rookMagics[64];
+        Magic bishopMagics[64];
+
+        // sized for the exact number of occupancy subsets of every square
+        static Bitboard rookTable[102400];
+        static Bitboard bishopTable[5248];
+
+        // the first of the four directions a slider moves in, see Direction
+        static const int ROOK_DIRECTIONS = NORTH;
+        static const int BISHOP_DIRECTIONS = NORTH_EAST;
+
+        /*
+         walk the rays one square at a time, only used to build the tables
+         */
+        static Bitboard slidingAttacks(int index, Bitboard occupied, int directions) {
+            Bitboard attacks = 0;
+            for (int d = directions; d < directions + 4; ++d) {
+                const Ray& ray = rays[index][d];
+                for (int i = 0; i < ray.length; ++i) {
+                    attacks |= square(ray.squares[i]);
+                    if (occupied & square(ray.squares[i]))
+                        break ;
+                }
+            }
+            return attacks;
+        }
+
+        /*
+         the relevant occupancy mask, ray squares minus the board edge
+         */
+        static Bitboard relevantMask(int index, int directions) {
+            Bitboard mask = 0;
+            for (int d = directions; d < directions + 4; ++d) {
+                const Ray& ray = rays[index][d];
+                for (int i = 0; i < ray.length - 1; ++i)
+                    mask |= square(ray.squares[i]);
+            }
+            return mask;
+        }
+
+        // xorshift, seeded so the magics (and the table layout) are reproducible
+        static uint64_t randomState = 0x9E3779B97F4A7C15ULL;
+        static uint64_t random64() {
+            randomState ^= randomState >> 12;
+            randomState ^= randomState << 25;
+            randomState ^= randomState >> 27;
+            return randomState * 2685821657736338717ULL;
+        }
+
+        static Bitboard sparseRandom() {
+            return random64() & random64() & random64();
+        }
+
+        /*
+         find a collision free magic for every square by trial and error, this
+         takes a few milliseconds at startup
+         */
+        static void initMagics(Magic* magics, Bitboard* table, int directions) {
+            Bitboard occupancy[4096];
+            Bitboard reference[4096];
+            int epoch[4096] = {0};
+            int attempt = 0;
+
+            Bitboard* next = table;
+            for (int index = 0; index < 64; ++index) {
+                Magic& m = magics[index];
+                m.mask = relevantMask(index, directions);
+                m.shift = 64 - popCount(m.mask);
+                m.attacks = next;
+
+                // enumerate all subsets of the mask (carry rippler)
+                int size = 0;
+                Bitboard subset = 0;
+                do {
+                    occupancy[size] = subset;
+                    reference[size] = slidingAttacks(index, subset, directions);
+                    size++;
+                    subset = (subset - m.mask) & m.mask;
+                } while (subset);
+
+                for (;;) {
+                    do {
+                        m.magic = sparseRandom();
+                    } while (popCount((m.mask * m.magic) >> 56) < 6);
+
+                    attempt++;
+                    int i = 0;
+                    for (; i < size; ++i) {
+                        unsigned idx = m.index(occupancy[i]);
+                        if (epoch[idx] < attempt) {
+                            epoch[idx] = attempt;
+                            m.attacks[idx] = reference[i];
+                        } else if (m.attacks[idx] != reference[i]) {
+                            break ;
+                        }
+                    }
+                    if (i == size)
+                        break ;
+                }
+
+                next += size;
+            }
+        }
+
+        static void init() {
+            initMagics(rookMagics, rookTable, ROOK_DIRECTIONS);
+            initMagics(bishopMagics, bishopTable, BISHOP_DIRECTIONS);
+
+            for (int a = 0; a < 64; ++a) {
+                for (int b = 0; b < 64; ++b) {
+                    between[a][b] = line[a][b] = 0;
+                    if (a == b)
+                        continue ;
+                    int directions;
+                    if (slidingAttacks(a, 0, ROOK_DIRECTIONS) & square(b))
+                        directions = ROOK_DIRECTIONS;
+                    else if (slidingAttacks(a, 0, BISHOP_DIRECTIONS) & square(b))
+                        directions = BISHOP_DIRECTIONS;
+                    else
+                        continue ;
+                    between[a][b] = slidingAttacks(a, square(b), directions) & slidingAttacks(b, square(a), directions);
+                    line[a][b] = (slidingAttacks(a, 0, directions) & slidingAttacks(b, 0, directions)) | square(a) | square(b);
+                }
+            }
+        }
+
+        /*
+         build the magic and line tables before main runs
+         */
+        static struct Initializer {
+            Initializer() { init(); }
+        } initializer;
+    }
+};
@@ -0,0 +1,161 @@
+#ifndef __BITBOARD_H_
+#define __BITBOARD_H_
+
+#include <stdint.h>
+
+namespace chess {
+
+typedef uint64_t Bitboard;
+
+/*
+ bitboard helpers and attack lookup tables, square 0 is a1 and square 63 is h8
+ (the same layout as Board::pieces)
+ */
+namespace bb {
+    const Bitboard FILE_A = 0x0101010101010101ULL;
+    const Bitboard FILE_H = FILE_A << 7;
+    const Bitboard RANK_1 = 0xFFULL;
+    const Bitboard RANK_2 = RANK_1 << 8;
+    const Bitboard RANK_3 = RANK_1 << 16;
+    const Bitboard RANK_6 = RANK_1 << 40;
+    const Bitboard RANK_7 = RANK_1 << 48;
+    const Bitboard RANK_8 = RANK_1 << 56;
+
+    inline Bitboard square(int index) { return 1ULL << index; }
+    inline int lsb(Bitboard b) { return __builtin_ctzll(b); }
+    inline int popCount(Bitboard b) { return __builtin_popcountll(b); }
+
+    inline int popLsb(Bitboard& b) {
+        int index = lsb(b);
+        b &= b - 1;
+        return index;
+    }
+
+    /*
+     a fixed size array that can be built and read at compile time
+     */
+    template<typename T, int N>
+    struct Table {
+        T values[N];
+
+        constexpr const T& operator [] (int index) const { return values[index]; }
+    };
+
+    /*
+     the squares walked from a square in one direction, nearest first
+     */
+    struct Ray {
+        int8_t length;
+        int8_t squares[7];
+    };
+
+    // rook directions first, then bishop directions
+    enum Direction {
+        NORTH, EAST, SOUTH, WEST,
+        NORTH_EAST, NORTH_WEST, SOUTH_EAST, SOUTH_WEST
+    };
+
+    namespace detail {
+        constexpr int directionX[8] = {0, 1, 0, -1, 1, -1, 1, -1};
+        constexpr int directionY[8] = {1, 0, -1, 0, 1, 1, -1, -1};
+
+        constexpr int knightX[8] = {2, 1, 2, 1, -2, -1, -2, -1};
+        constexpr int knightY[8] = {1, 2, -1, -2, 1, 2, -1, -2};
+        constexpr int pawnX[2] = {1, -1};
+        constexpr int whitePawnY[2] = {1, 1};
+        constexpr int blackPawnY[2] = {-1, -1};
+
+        constexpr bool onBoard(int x, int y) {
+            return x >= 0 && x < 8 && y >= 0 && y < 8;
+        }
+
+        template<int N>
+        constexpr Table<Bitboard, 64> leaperTable(const int (&dx)[N], const int (&dy)[N]) {
+            Table<Bitboard, 64> table = {};
+            for (int index = 0; index < 64; ++index) {
+                for (int i = 0; i < N; ++i) {
+                    int x = index % 8 + dx[i];
+                    int y = index / 8 + dy[i];
+                    if (onBoard(x, y))
+                        table.values[index] |= 1ULL << (x + y * 8);
+                }
+            }
+            return table;
+        }
+
+        constexpr Table<Table<Bitboard, 64>, 2> pawnTable() {
+            Table<Table<Bitboard, 64>, 2> table = {};
+            table.values[0] = leaperTable(pawnX, whitePawnY);
+            table.values[1] = leaperTable(pawnX, blackPawnY);
+            return table;
+        }
+
+        constexpr Table<Table<Ray, 8>, 64> rayTable() {
+            Table<Table<Ray, 8>, 64> table = {};
+            for (int index = 0; index < 64; ++index) {
+                for (int d = 0; d < 8; ++d) {
+                    Ray& ray = table.values[index].values[d];
+                    int x = index % 8 + directionX[d];
+                    int y = index / 8 + directionY[d];
+                    while (onBoard(x, y)) {
+                        ray.squares[ray.length++] = (int8_t) (x + y * 8);
+                        x += directionX[d];
+                        y += directionY[d];
+                    }
+                }
+            }
+            return table;
+        }
+    }
+
+    /*
+     leaper and ray tables, all built by the compiler. pawnAttacks is indexed
+     by color (0 = white, 1 = black), rays by square then Direction
+     */
+    constexpr Table<Bitboard, 64> knightAttacks = detail::leaperTable(detail::knightX, detail::knightY);
+    constexpr Table<Bitboard, 64> kingAttacks = detail::leaperTable(detail::directionX, detail::directionY);
+    constexpr Table<Table<Bitboard, 64>, 2> pawnAttacks = detail::pawnTable();
+    constexpr Table<Table<Ray, 8>, 64> rays = detail::rayTable();
+
+    /*
+     magic bitboard entry for one square, attacks points into a shared table
+     */
+    struct Magic {
+        Bitboard mask;
+        Bitboard magic;
+        Bitboard* attacks;
+        int shift;
+
+        inline unsigned index(Bitboard occupied) const {
+            return (unsigned) (((occupied & mask) * magic) >> shift);
+        }
+    };
+
+    /*
+     squares strictly between two squares on a shared rank, file or diagonal,
+     and the whole line through them (both empty when they share none)
+     */
+    extern Bitboard between[64][64];
+    extern Bitboard line[64][64];
+
+    extern Magic rookMagics[64];
+    extern Magic bishopMagics[64];
+
+    inline Bitboard rookAttacks(int index, Bitboard occupied) {
+        const Magic& m = rookMagics[index];
+        return m.attacks[m.index(occupied)];
+    }
+
+    inline Bitboard bishopAttacks(int index, Bitboard occupied) {
+        const Magic& m = bishopMagics[index];
+        return m.attacks[m.index(occupied)];
+    }
+
+    inline Bitboard queenAttacks(int index, Bitboard occupied) {
+        return rookAttacks(index, occupied) | bishopAttacks(index, occupied);
+    }
+}
+
+};
+
+#endif
@@ -6,32 +6,121 @@
 
 namespace chess {
 
+    namespace zobrist {
+        uint64_t pieceKeys[2][7][BOARD_SPACES];
+        uint64_t sideKey;
+        uint64_t castleKeys[8];
+
+        // splitmix64, fixed seed so keys are stable between runs and builds
+        static uint64_t next(uint64_t& state) {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        }
+
+        static struct Initializer {
+            Initializer() {
+                uint64_t state = 0x3243F6A8885A308DULL;
+                for (int c = 0; c < 2; ++c)
+                    for (int p = 0; p < 7; ++p)
+                        for (int i = 0; i < BOARD_SPACES; ++i)
+                            pieceKeys[c][p][i] = next(state);
+                sideKey = next(state);
+                castleKeys[0] = 0;
+                for (int i = 1; i < 8; ++i)
+                    castleKeys[i] = next(state);
+            }
+        } initializer;
+    }
+
     Board::Board() {
         // zero fill the board
         std::fill(pieces, pieces + BOARD_SPACES, 0);
-        score = 0; // zero the score
+        mgScore = egScore = phase = 0; // zero the score
         haveCastled = 0;
+        turn = 1;
+        hash = 0;
+        for (int c = 0; c < 2; ++c) {
+            std::fill(bitboards[c], bitboards[c] + 7, 0);
+            std::fill(pieceCounts[c], pieceCounts[c] + 7, 0);
+        }
+    }
+
+    uint64_t Board::computeHash() const {
+        uint64_t key = zobrist::castleKeys[haveCastled];
+        if (turn == -1)
+            key ^= zobrist::sideKey;
+        Bitboard occupied = this->occupied();
+        while (occupied) {
+            int i = bb::popLsb(occupied);
+            key ^= zobrist::pieceKey(pieces[i], i);
+        }
+        return key;
     }
     
     void Board::setup() {
         
         for (int i = 0; i < BOARD_DIM; ++i) {
-            this->pieces[BOARD_DIM * 1 + i] =  PIECE_PAWN;
-            this->pieces[BOARD_DIM * 6 + i] = -PIECE_PAWN;
+            this->setPiece(BOARD_DIM * 1 + i,  PIECE_PAWN);
+            this->setPiece(BOARD_DIM * 6 + i, -PIECE_PAWN);
         }
         
-        this->pieces[3] = PIECE_QUEEN;
-        this->pieces[4] = PIECE_KING;
-        this->pieces[0] = this->pieces[7] = PIECE_ROOK;
-        this->pieces[1] = this->pieces[6] = PIECE_KNIGHT;
-        this->pieces[2] = this->pieces[5] = PIECE_BISHOP;
+        static const Piece backRank[BOARD_DIM] = {
+            PIECE_ROOK, PIECE_KNIGHT, PIECE_BISHOP, PIECE_QUEEN, PIECE_KING, PIECE_BISHOP, PIECE_KNIGHT, PIECE_ROOK
+        };
         
         const int blackOffset = BOARD_DIM * 7;
-        this->pieces[blackOffset + 0] = this->pieces[blackOffset + 7] = -PIECE_ROOK;
-        this->pieces[blackOffset + 1] = this->pieces[blackOffset + 6] = -PIECE_KNIGHT;
-        this->pieces[blackOffset + 2] = this->pieces[blackOffset + 5] = -PIECE_BISHOP;
-        this->pieces[blackOffset + 3] = -PIECE_QUEEN;
-        this->pieces[blackOffset + 4] = -PIECE_KING;
+        for (int i = 0; i < BOARD_DIM; ++i) {
+            this->setPiece(i, backRank[i]);
+            this->setPiece(blackOffset + i, -backRank[i]);
+        }
+    }
+
+    bool Board::loadFEN(const std::string& fen) {
+        *this = Board();
+
+        std::istringstream in(fen);
+        std::string placement, side;
+        if (!(in >> placement))
+            return false;
+
+        int x = 0;
+        int y = BOARD_DIM - 1;
+        for (char c : placement) {
+            if (c == '/') {
+                if (x != BOARD_DIM || y == 0)
+                    return false;
+                x = 0;
+                y--;
+            } else if (c >= '1' && c <= '8') {
+                x += c - '0';
+            } else {
+                Piece piece;
+                switch (c < 'a' ? c : c - 'a' + 'A') {
+                    case 'P': piece = PIECE_PAWN; break ;
+                    case 'N': piece = PIECE_KNIGHT; break ;
+                    case 'B': piece = PIECE_BISHOP; break ;
+                    case 'R': piece = PIECE_ROOK; break ;
+                    case 'Q': piece = PIECE_QUEEN; break ;
+                    case 'K': piece = PIECE_KING; break ;
+                    default: return false;
+                }
+                if (x >= BOARD_DIM)
+                    return false;
+                setPiece(toIndex(x, y), c < 'a' ? piece : -piece);
+                x++;
+            }
+            if (x > BOARD_DIM)
+                return false;
+        }
+        if (x != BOARD_DIM || y != 0)
+            return false;
+
+        // castling rights, en passant and the move counters are not modelled
+        if (in >> side)
+            setTurn(side == "b" ? -1 : 1);
+        return true;
     }
 
     void Board::print() const {
@@ -72,15 +161,23 @@ namespace chess {
 
     /*
      move generator which is crazily (maybe almost stupidly recursively templated)
+
+     the reference generator below walks the same constexpr ray and leaper
+     tables as the bitboard one but square by square, perft --perft-check
+     runs both and compares their counts
      */
 
     namespace mg {
         struct OnlyIfEmpty {
-            inline static bool add(Player player, Piece piece) {
+            inline static bool add(Player, Piece piece) {
                 return piece == 0;
             }
 
-            inline static bool cont(Player player, Piece piece) {
+            inline static Bitboard targets(Board* board, Player) {
+                return ~board->occupied();
+            }
+
+            inline static bool cont(Player, Piece) {
                 return true;
             }
         };
@@ -89,6 +186,10 @@ namespace chess {
                 return piece * player <= 0;
             }
 
+            inline static Bitboard targets(Board* board, Player player) {
+                return ~board->piecesOf(player);
+            }
+
             inline static bool cont(Player player, Piece piece) {
                 return piece * player == 0;
             }
@@ -99,169 +200,130 @@ namespace chess {
                 return player * piece < 0;
             }
 
-            inline static bool cont(Player player, Piece piece) {
+            inline static Bitboard targets(Board* board, Player player) {
+                return board->piecesOf(-player);
+            }
+
+            inline static bool cont(Player, Piece) {
                 return false;
             }
         };
 
 
-        template<typename T>
-        inline T min(T a, T b) {
-            return a > b ? a : b;
-        }
-
         template<class STORE, class CONDITIONAL>
         bool moveTo(Board* board, int from, int to, Player player, STORE& iter) {
             if (!CONDITIONAL::add(player, board->pieceAt(to)))
                 return false;
-            iter.put(Move(board, from, to));
+            iter.put(Move(from, to));
             return CONDITIONAL::cont(player, board->pieceAt(to));
         }
 
-        template<class STORE, class CONDITIONAL, int dx, int dy>
-        void addAlongVector(Board* board, int index, Player player, STORE& iter) {
-            const int indexOffset = dy * BOARD_DIM + dx;
-            const int x = Board::getX(index);
-            const int y = Board::getY(index);
-
-            int reps = INT_MAX;
-            if (dx != 0) {
-                if (dx < 0) {
-                    if (reps > x / (-dx))
-                        reps = x / (-dx);
-                } else {
-                    if (reps > (BOARD_DIM - x - 1) / dx)
-                        reps = (BOARD_DIM - x - 1) / dx;
-                }
+        template<class STORE, class CONDITIONAL, int direction>
+        void addAlongRay(Board* board, int from, Player player, STORE& iter) {
+            const bb::Ray& ray = bb::rays[from][direction];
+            for (int i = 0; i < ray.length; ++i) {
+                if (!moveTo<STORE, CONDITIONAL>(board, from, ray.squares[i], player, iter))
+                    break ;
             }
-            if (dy != 0) {
-                if (dy < 0) {
-                    if (reps > y / (-dy))
-                        reps = y / (-dy);
-                } else {
-                    if (reps > (BOARD_DIM - y - 1) / dy)
-                        reps = (BOARD_DIM - y - 1) / dy;
-                }
+        };
+
+        template<class STORE, class CONDITIONAL>
+        void addLeaperTargets(Board* board, int from, Bitboard targets, Player player, STORE& iter) {
+            while (targets)
+                moveTo<STORE, CONDITIONAL>(board, from, bb::popLsb(targets), player, iter);
+        }
+
+        template<class STORE>
+        void addPawnTarget(int from, int to, bool promote, STORE& iter) {
+            if (promote) {
+                // only two pieces that you should ever really want to add...
+                iter.put(Move(from, to, PIECE_QUEEN));
+                iter.put(Move(from, to, PIECE_KNIGHT));
+            } else {
+                iter.put(Move(from, to));
             }
+        }
 
-            for (int i = 1; i <= reps; ++i) {
-                if (!moveTo<STORE, CONDITIONAL>(board, index, index + indexOffset * i, player, iter))
-                    break ;
+        /*
+         the length of the ray ahead of a pawn tells its rank: 1 means the next
+         step promotes, 6 means it has not moved yet
+         */
+        template<class STORE, int forward>
+        void addPawnMovesAt(Board* board, int from, Player player, STORE& iter) {
+            const bb::Ray& ahead = bb::rays[from][forward];
+            if (ahead.length == 0)
+                return ;
+            const bool promote = ahead.length == 1;
+
+            if (OnlyIfEmpty::add(player, board->pieceAt(ahead.squares[0]))) {
+                addPawnTarget(from, ahead.squares[0], promote, iter);
+                if (ahead.length == 6)
+                    moveTo<STORE, OnlyIfEmpty>(board, from, ahead.squares[1], player, iter);
             }
-        };
 
-        template<class STORE, class CONDITIONAL, int dx, int dy>
-        bool moveToIfInBounds(Board* board, int from, Player player, STORE& iter) {
-            int x = Board::getX(from) + dx;
-            int y = Board::getY(from) + dy;
-            if (x < 0 || x >= BOARD_DIM || y < 0 || y >= BOARD_DIM)
-                return false;
-            if (CONDITIONAL::add(player, board->pieceAt(Board::toIndex(x, y)))) {
-                iter.put(Move(board, from, Board::toIndex(x, y)));
-                return true;
+            Bitboard captures = bb::pawnAttacks[Board::playerIndex(player)][from];
+            while (captures) {
+                int to = bb::popLsb(captures);
+                if (OnlyIfCapture::add(player, board->pieceAt(to)))
+                    addPawnTarget(from, to, promote, iter);
             }
-            return false;
         }
 
         template<class STORE>
         void addMovesAtPosition(Board* board, int from, Player player, STORE& iter) {
-            int x = Board::getX(from);
-            int y = Board::getY(from);
-
             Piece p = board->pieceAt(from) * player;
 
             switch (p) {
                 case PIECE_PAWN:
 
-                    if (player == 1) {
-                        if (y == 6) {
-                            // pawn promotion!
-                            if (OnlyIfEmpty::add(player, board->pieceAt(Board::toIndex(x, 7)))) {
-                                // only two pieces that you should ever really want to add...
-                                iter.put(Move(board, from, Board::toIndex(x, 7), PIECE_QUEEN));
-                                iter.put(Move(board, from, Board::toIndex(x, 7), PIECE_KNIGHT));
-                            }
-                        } else if (moveToIfInBounds<STORE, OnlyIfEmpty,0,1>(board, from, player, iter) && y == 1) {
-                            moveToIfInBounds<STORE, OnlyIfEmpty,0,2>(board, from, player, iter);
-                        }
-                        moveToIfInBounds<STORE, OnlyIfCapture, 1, 1>(board, from, player, iter);
-                        moveToIfInBounds<STORE, OnlyIfCapture, -1, 1>(board, from, player, iter);
-                    } else if (player == -1) {
-                        if (y == 1) {
-                            // pawn promotion!
-                            if (OnlyIfEmpty::add(player, board->pieceAt(Board::toIndex(x, 0)))) {
-                                // only two pieces that you should ever really want to add...
-                                iter.put(Move(board, from, Board::toIndex(x, 0), -PIECE_QUEEN));
-                                iter.put(Move(board, from, Board::toIndex(x, 0), -PIECE_KNIGHT));
-                            }
-                        } else if (moveToIfInBounds<STORE, OnlyIfEmpty,0,-1>(board, from, player, iter) && y == 6) {
-                            moveToIfInBounds<STORE, OnlyIfEmpty,0,-2>(board, from, player, iter);
-                        }
-                        moveToIfInBounds<STORE, OnlyIfCapture, 1, -1>(board, from, player, iter);
-                        moveToIfInBounds<STORE, OnlyIfCapture, -1, -1>(board, from, player, iter);
-                    }
+                    if (player == 1)
+                        addPawnMovesAt<STORE, bb::NORTH>(board, from, player, iter);
+                    else
+                        addPawnMovesAt<STORE, bb::SOUTH>(board, from, player, iter);
 
                     break ;
 
                 case PIECE_KNIGHT:
 
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 2,1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 1,2>(board, from, player, iter);
-
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 2,-1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 1,-2>(board, from, player, iter);
-
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, -2,1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, -1,2>(board, from, player, iter);
-
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, -2,-1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, -1,-2>(board, from, player, iter);
+                    addLeaperTargets<STORE, OnlyIfEmptyOrCapture>(board, from, bb::knightAttacks[from], player, iter);
 
                     break ;
 
                 case PIECE_ROOK:
 
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 1, 0>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 0, 1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, -1, 0>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 0, -1>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::EAST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::NORTH>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::WEST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::SOUTH>(board, from, player, iter);
 
                     break ;
 
                 case PIECE_BISHOP:
 
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 1, 1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, -1, 1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 1, -1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, -1, -1>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::NORTH_EAST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::NORTH_WEST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::SOUTH_EAST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::SOUTH_WEST>(board, from, player, iter);
 
                     break ;
 
                 case PIECE_QUEEN:
 
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 1, 1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, -1, 1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 1, -1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, -1, -1>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::NORTH_EAST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::NORTH_WEST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::SOUTH_EAST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::SOUTH_WEST>(board, from, player, iter);
 
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 1, 0>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 0, 1>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, -1, 0>(board, from, player, iter);
-                    addAlongVector<STORE, OnlyIfEmptyOrCapture, 0, -1>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::EAST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::NORTH>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::WEST>(board, from, player, iter);
+                    addAlongRay<STORE, OnlyIfEmptyOrCapture, bb::SOUTH>(board, from, player, iter);
 
                     break ;
 
                 case PIECE_KING:
 
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 0, 1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 0, -1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 1, 0>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, -1, 0>(board, from, player, iter);
-
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 1, 1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, 1, -1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, -1, 1>(board, from, player, iter);
-                    moveToIfInBounds<STORE, OnlyIfEmptyOrCapture, -1, -1>(board, from, player, iter);
+                    addLeaperTargets<STORE, OnlyIfEmptyOrCapture>(board, from, bb::kingAttacks[from], player, iter);
 
                     break ;
 
@@ -271,31 +333,291 @@ namespace chess {
         }
     }
 
+    template<class STORE> void generateMovesReference(Board* board, Player player, STORE& iter) {
+        Bitboard pieces = board->piecesOf(player);
+        while (pieces) {
+            mg::addMovesAtPosition<STORE>(board, bb::popLsb(pieces), player, iter);
+        }
+    }
+
+
+    CheckInfo::CheckInfo(Board* board, Player player) {
+        checkers = pinned = 0;
+        evasionMask = ~0ULL;
+
+        Bitboard kings = board->piecesOf(player, PIECE_KING);
+        if (!kings) {
+            king = -1;
+            return ;
+        }
+        king = bb::lsb(kings);
+
+        const Bitboard occupied = board->occupied();
+        checkers = board->attackersTo(king, occupied) & board->piecesOf(-player);
+
+        // enemy sliders that would hit the king on an empty board, pinning if exactly one of ours is between
+        Bitboard snipers = (bb::rookAttacks(king, 0) & (board->piecesOf(-player, PIECE_ROOK) | board->piecesOf(-player, PIECE_QUEEN)))
+            | (bb::bishopAttacks(king, 0) & (board->piecesOf(-player, PIECE_BISHOP) | board->piecesOf(-player, PIECE_QUEEN)));
+        while (snipers) {
+            int sniper = bb::popLsb(snipers);
+            Bitboard blockers = bb::between[king][sniper] & occupied;
+            if (blockers && !(blockers & (blockers - 1)) && (blockers & board->piecesOf(player)))
+                pinned |= blockers;
+        }
+
+        if (checkers) {
+            if (checkers & (checkers - 1))
+                evasionMask = 0;
+            else
+                evasionMask = checkers | bb::between[king][bb::lsb(checkers)];
+        }
+    }
+
+
+    /*
+     bitboard move generator, every piece produces a target set in one lookup
+     and the CONDITIONAL policies become masks. the CheckInfo masks keep every
+     move legal
+     */
+
+    namespace mg {
+        template<int shift>
+        inline Bitboard shiftBy(Bitboard b) {
+            return shift > 0 ? b << shift : b >> -shift;
+        }
+
+        template<class STORE>
+        inline void putTargets(int from, Bitboard targets, STORE& iter) {
+            while (targets)
+                iter.put(Move(from, bb::popLsb(targets)));
+        }
+
+        template<class STORE>
+        inline void putPromotions(int from, int to, STORE& iter) {
+            // only two pieces that you should ever really want to add...
+            iter.put(Move(from, to, PIECE_QUEEN));
+            iter.put(Move(from, to, PIECE_KNIGHT));
+        }
+
+        template<class STORE>
+        inline void putPawnMoves(Bitboard targets, int offset, bool promote, const CheckInfo& info, STORE& iter) {
+            while (targets) {
+                int to = bb::popLsb(targets);
+                int from = to - offset;
+                if (!info.pinAllows(from, to))
+                    continue ;
+                if (promote)
+                    putPromotions(from, to, iter);
+                else
+                    iter.put(Move(from, to));
+            }
+        }
+
+        /*
+         pawn pushes follow CONDITIONAL's rule for empty squares, captures and
+         promotions its rule for enemy pieces, so OnlyIfCapture yields every
+         capture and promotion and OnlyIfEmpty every other pawn move
+         */
+        template<class STORE, class CONDITIONAL, Player player>
+        void addPawnMoves(Board* board, const CheckInfo& info, STORE& iter) {
+            const int forward = player == 1 ? 8 : -8;
+            const Bitboard promotionRank = player == 1 ? bb::RANK_8 : bb::RANK_1;
+            const Bitboard doublePushRank = player == 1 ? bb::RANK_3 : bb::RANK_6;
+            const bool quiets = CONDITIONAL::add(player, PIECE_EMPTY);
+            const bool captures = CONDITIONAL::add(player, -player);
+
+            const Bitboard pawns = board->piecesOf(player, PIECE_PAWN);
+            const Bitboard empty = ~board->occupied();
+            const Bitboard enemies = board->piecesOf(-player);
+
+            const Bitboard single = shiftBy<forward>(pawns) & empty;
+
+            if (captures)
+                putPawnMoves(single & promotionRank & info.evasionMask, forward, true, info, iter);
+
+            if (quiets) {
+                Bitboard doubles = shiftBy<forward>(single & doublePushRank) & empty;
+                putPawnMoves(single & ~promotionRank & info.evasionMask, forward, false, info, iter);
+                putPawnMoves(doubles & info.evasionMask, 2 * forward, false, info, iter);
+            }
+
+            if (!captures)
+                return ;
+
+            // captures towards the a file and towards the h file
+            const int west = forward - 1;
+            const int east = forward + 1;
+            const Bitboard westCaptures = shiftBy<west>(pawns & ~bb::FILE_A) & enemies & info.evasionMask;
+            const Bitboard eastCaptures = shiftBy<east>(pawns & ~bb::FILE_H) & enemies & info.evasionMask;
+            putPawnMoves(westCaptures & promotionRank, west, true, info, iter);
+            putPawnMoves(westCaptures & ~promotionRank, west, false, info, iter);
+            putPawnMoves(eastCaptures & promotionRank, east, true, info, iter);
+            putPawnMoves(eastCaptures & ~promotionRank, east, false, info, iter);
+        }
+
+        template<class STORE, class CONDITIONAL, Player player>
+        void addPieceMoves(Board* board, const CheckInfo& info, STORE& iter) {
+            const Bitboard targets = CONDITIONAL::targets(board, player) & info.evasionMask;
+            const Bitboard occupied = board->occupied();
+
+            Bitboard knights = board->piecesOf(player, PIECE_KNIGHT) & ~info.pinned; // a pinned knight never moves
+            while (knights) {
+                int from = bb::popLsb(knights);
+                putTargets(from, bb::knightAttacks[from] & targets, iter);
+            }
+
+            Bitboard bishops = board->piecesOf(player, PIECE_BISHOP);
+            while (bishops) {
+                int from = bb::popLsb(bishops);
+                Bitboard moves = bb::bishopAttacks(from, occupied) & targets;
+                if (info.pinned & bb::square(from))
+                    moves &= bb::line[info.king][from];
+                putTargets(from, moves, iter);
+            }
+
+            Bitboard rooks = board->piecesOf(player, PIECE_ROOK);
+            while (rooks) {
+                int from = bb::popLsb(rooks);
+                Bitboard moves = bb::rookAttacks(from, occupied) & targets;
+                if (info.pinned & bb::square(from))
+                    moves &= bb::line[info.king][from];
+                putTargets(from, moves, iter);
+            }
+
+            Bitboard queens = board->piecesOf(player, PIECE_QUEEN);
+            while (queens) {
+                int from = bb::popLsb(queens);
+                Bitboard moves = bb::queenAttacks(from, occupied) & targets;
+                if (info.pinned & bb::square(from))
+                    moves &= bb::line[info.king][from];
+                putTargets(from, moves, iter);
+            }
+        }
+
+        /*
+         the king may not step onto an attacked square, tested with the king
+         lifted off the board so it cannot hide behind itself from a slider
+         */
+        template<class STORE, class CONDITIONAL, Player player>
+        void addKingMoves(Board* board, const CheckInfo& info, STORE& iter) {
+            Bitboard kings = board->piecesOf(player, PIECE_KING);
+            while (kings) {
+                int from = bb::popLsb(kings);
+                const Bitboard occupied = board->occupied() ^ bb::square(from);
+                Bitboard targets = bb::kingAttacks[from] & CONDITIONAL::targets(board, player);
+                while (targets) {
+                    int to = bb::popLsb(targets);
+                    if (info.king != from || !board->isAttacked(to, -player, occupied))
+                        iter.put(Move(from, to));
+                }
+            }
+        }
+
+        template<class STORE, class CONDITIONAL, Player player>
+        inline void generate(Board* board, const CheckInfo& info, STORE& iter) {
+            if (info.evasionMask) {
+                addPawnMoves<STORE, CONDITIONAL, player>(board, info, iter);
+                addPieceMoves<STORE, CONDITIONAL, player>(board, info, iter);
+            }
+            // in check the evasion mask leaves only captures of the checker and blocks, in double check only this
+            addKingMoves<STORE, CONDITIONAL, player>(board, info, iter);
+        }
+
+        template<class STORE, class CONDITIONAL>
+        inline void generate(Board* board, Player player, const CheckInfo& info, STORE& iter) {
+            if (player == 1)
+                generate<STORE, CONDITIONAL, 1>(board, info, iter);
+            else
+                generate<STORE, CONDITIONAL, -1>(board, info, iter);
+        }
+    }
+
     template<class STORE> void generateMoves(Board* board, Player player, STORE& iter) {
-        for (int i = BOARD_SPACES - 1; i >= 0; --i) {
-            if (board->pieceAt(i) * player > 0) {
-                mg::addMovesAtPosition<STORE>(board, i, player, iter);
+        CheckInfo info(board, player);
+        mg::generate<STORE, mg::OnlyIfEmptyOrCapture>(board, player, info, iter);
+    }
+
+    template<class STORE> void generateCaptures(Board* board, Player player, const CheckInfo& info, STORE& iter) {
+        mg::generate<STORE, mg::OnlyIfCapture>(board, player, info, iter);
+    }
+
+    template<class STORE> void generateQuiets(Board* board, Player player, const CheckInfo& info, STORE& iter) {
+        mg::generate<STORE, mg::OnlyIfEmpty>(board, player, info, iter);
+    }
+
+    bool isPseudoLegal(Board* board, Player player, Move move) {
+        const int from = move.from();
+        const int to = move.to();
+        const Piece piece = board->pieceAt(from) * player;
+        if (move.isNull() || move.isCastle() || piece <= 0 || board->pieceAt(to) * player > 0)
+            return false;
+
+        const Bitboard target = bb::square(to);
+        const Bitboard occupied = board->occupied();
+        const bool lastRank = (target & (bb::RANK_1 | bb::RANK_8)) != 0;
+
+        if (piece != PIECE_PAWN) {
+            if (move.promotion())
+                return false;
+            switch (piece) {
+                case PIECE_KNIGHT: return (bb::knightAttacks[from] & target) != 0;
+                case PIECE_BISHOP: return (bb::bishopAttacks(from, occupied) & target) != 0;
+                case PIECE_ROOK: return (bb::rookAttacks(from, occupied) & target) != 0;
+                case PIECE_QUEEN: return (bb::queenAttacks(from, occupied) & target) != 0;
+                case PIECE_KING: return (bb::kingAttacks[from] & target) != 0;
+                default: return false;
             }
         }
+
+        if (lastRank != (move.promotion() != 0))
+            return false;
+        if (move.promotion() && move.promotion() != PIECE_QUEEN && move.promotion() != PIECE_KNIGHT)
+            return false;
+
+        const int forward = player == 1 ? 8 : -8;
+        if (board->pieceAt(to) != PIECE_EMPTY)
+            return (bb::pawnAttacks[Board::playerIndex(player)][from] & target) != 0;
+        if (to == from + forward)
+            return true;
+        const int startRank = player == 1 ? 1 : 6;
+        return to == from + 2 * forward && Board::getY(from) == startRank && board->pieceAt(from + forward) == PIECE_EMPTY;
+    }
+
+    bool isLegal(Board* board, Player player, Move move, const CheckInfo& info) {
+        if (!isPseudoLegal(board, player, move))
+            return false;
+        if (info.king < 0)
+            return true;
+        if (move.from() == info.king)
+            return !board->isAttacked(move.to(), -player, board->occupied() ^ bb::square(info.king));
+        return (info.evasionMask & bb::square(move.to())) && info.pinAllows(move.from(), move.to());
     }
 
 
     template void generateMoves<MoveIterator>(Board* board, Player player, MoveIterator& iter);
+    template void generateMoves<MoveCounter>(Board* board, Player player, MoveCounter& iter);
+    template void generateCaptures<StagedMoveIterator>(Board* board, Player player, const CheckInfo& info, StagedMoveIterator& iter);
+    template void generateQuiets<StagedMoveIterator>(Board* board, Player player, const CheckInfo& info, StagedMoveIterator& iter);
+    template void generateMovesReference<LegalReferenceMoves>(Board* board, Player player, LegalReferenceMoves& iter);
     
     std::string Move::toString() const {
-        std::stringstream ss;
-        
-        for (int i = 0; i < sizeof(changes) / sizeof(PiecePositionPair); ++i) {
-            if (changes[i].position < 0) {
-                if (changes[i].position == -2) {
-                    ss << "castle" << std::endl;
-                    break ;
-                }
-                break ;
-            }
-            ss << (char) ('a' + Board::getX(changes[i].position)) << Board::getY(changes[i].position) << "=" << pieceGetLetter(changes[i].piece) << ":";
-        }
-        return ss.str();
+        if (isCastle())
+            return toLongAlgebraic() + " (castle)";
+        return toLongAlgebraic();
+    }
+
+    std::string Move::toLongAlgebraic() const {
+        if (isNull())
+            return "0000";
+
+        std::string name;
+        name += (char) ('a' + Board::getX(from()));
+        name += (char) ('1' + Board::getY(from()));
+        name += (char) ('a' + Board::getX(to()));
+        name += (char) ('1' + Board::getY(to()));
+        if (promotion())
+            name += (char) (pieceGetLetter(promotion()) - 'A' + 'a');
+        return name;
     }
 
 };
\ No newline at end of file
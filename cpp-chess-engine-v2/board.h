@@ -6,6 +6,8 @@
 #include <cassert>
 #include <algorithm>
 #include <string>
+#include "bitboard.h"
+#include "psqt.h"
 
 namespace chess {
 
@@ -30,6 +32,21 @@ const int8_t FLAG_WHITE_CASTLED = 2;
 const int8_t FLAG_BLACK_CASTLED = 4;
 
 
+/*
+ zobrist keys, the empty board with white to move and nobody castled hashes
+ to 0 so a fresh Board is valid even before the keys are initialized
+ */
+namespace zobrist {
+    extern uint64_t pieceKeys[2][7][BOARD_SPACES];
+    extern uint64_t sideKey;
+    extern uint64_t castleKeys[8];
+
+    inline uint64_t pieceKey(Piece piece, Position position) {
+        return pieceKeys[piece < 0 ? 1 : 0][piece < 0 ? -piece : piece][position];
+    }
+}
+
+
 /*
  get piece values
  */
@@ -89,29 +106,229 @@ inline char pieceGetLetter(Piece piece) {
 }
 
 
+/*
+ essentially a move in a chess game, packed into 16 bits:
+ from | to << 6 | promotion piece type << 12 | castle flag << 15
+ */
+struct Move {
+    uint16_t data;
+
+    inline Move() : data(0) { }
+
+    inline Move(int from, int to) : data((uint16_t) (from | (to << 6))) { }
+
+    // used for pawn promotion, promotion is the (unsigned) piece type
+    inline Move(int from, int to, Piece promotion) : data((uint16_t) (from | (to << 6) | (promotion << 12))) { }
+
+    // swaps the pieces on from and to and marks the owner as castled
+    inline static Move castle(int from, int to) {
+        Move move(from, to);
+        move.data |= 1 << 15;
+        return move;
+    }
+
+    inline int from() const { return data & 63; };
+    inline int to() const { return (data >> 6) & 63; };
+    inline Piece promotion() const { return (data >> 12) & 7; };
+    inline bool isCastle() const { return (data >> 15) != 0; };
+    inline bool isNull() const { return data == 0; };
+
+    std::string toString() const;
+
+    // coordinate notation, e.g. e2e4 or a7a8q
+    std::string toLongAlgebraic() const;
+};
+
+inline bool operator == (const Move& a, const Move& b) {
+    return a.data == b.data;
+}
+
+inline bool operator != (const Move& a, const Move& b) {
+    return a.data != b.data;
+}
+
+inline std::ostream& operator << (std::ostream& o, const Move& move) {
+    o << move.toString();
+    return o;
+}
+
+/*
+ everything a move destroys, enough to take it back
+ */
+struct Undo {
+    uint64_t hash;
+    Piece captured;
+    int8_t haveCastled;
+};
+
+
 /*
  a chess board!
  */
 struct Board {
-    int score;
+    /*
+     material and piece-square totals from white's point of view, kept up to
+     date by setPiece along with the phase (how much non-pawn material is left)
+     so evaluating a leaf never has to look at the pieces
+     */
+    int mgScore;
+    int egScore;
+    int phase;
     int8_t haveCastled;
+    Player turn;
+    uint64_t hash;
     Piece pieces[BOARD_SPACES];
 
+    /*
+     bitboards mirroring pieces, indexed by color (0 = white, 1 = black) and
+     piece type, slot 0 of each color holds every piece of that color
+     */
+    Bitboard bitboards[2][7];
+
+    /*
+     how many of each piece every side has, laid out like bitboards. the
+     bitboards double as the piece lists, these answer "how much is left"
+     without a popcount
+     */
+    int8_t pieceCounts[2][7];
+
     Board();
 
+    inline static int colorIndex(Piece piece) { return piece < 0 ? 1 : 0; };
+    inline static int playerIndex(Player player) { return player < 0 ? 1 : 0; };
+
     inline void setPiece(Position position, Piece piece) {
-        if (pieces[position] != 0)
-            score -= pieceGetValueSigned(pieces[position]);
-        if (piece != 0)
-            score += pieceGetValueSigned(piece);
+        const Bitboard bit = bb::square(position);
+        Piece old = pieces[position];
+        if (old != 0) {
+            const int color = colorIndex(old), type = old < 0 ? -old : old;
+            mgScore -= psqt::mg[color][type][position];
+            egScore -= psqt::eg[color][type][position];
+            phase -= psqt::phaseWeights[type];
+            hash ^= zobrist::pieceKey(old, position);
+            bitboards[color][0] &= ~bit;
+            bitboards[color][type] &= ~bit;
+            pieceCounts[color][0]--;
+            pieceCounts[color][type]--;
+        }
+        if (piece != 0) {
+            const int color = colorIndex(piece), type = piece < 0 ? -piece : piece;
+            mgScore += psqt::mg[color][type][position];
+            egScore += psqt::eg[color][type][position];
+            phase += psqt::phaseWeights[type];
+            hash ^= zobrist::pieceKey(piece, position);
+            bitboards[color][0] |= bit;
+            bitboards[color][type] |= bit;
+            pieceCounts[color][0]++;
+            pieceCounts[color][type]++;
+        }
 
         pieces[position] = piece;
     }
 
-    inline Piece pieceAt(Position position) { return pieces[position]; };
+    inline Piece pieceAt(Position position) const { return pieces[position]; };
+
+    inline void setTurn(Player player) {
+        if (player != turn)
+            hash ^= zobrist::sideKey;
+        turn = player;
+    }
+
+    inline void setCastled(int8_t flags) {
+        hash ^= zobrist::castleKeys[haveCastled] ^ zobrist::castleKeys[flags];
+        haveCastled = flags;
+    }
+
+    // full recompute of the zobrist key, the incremental one must always match
+    uint64_t computeHash() const;
+
+    inline void makeMove(Move move, Undo& undo) {
+        const int from = move.from();
+        const int to = move.to();
+        const Piece mover = pieces[from];
+
+        undo.hash = hash;
+        undo.captured = pieces[to];
+        undo.haveCastled = haveCastled;
+
+        if (move.isCastle()) {
+            setPiece(from, pieces[to]);
+            setPiece(to, mover);
+            setCastled(haveCastled | (mover > 0 ? FLAG_WHITE_CASTLED : FLAG_BLACK_CASTLED));
+        } else {
+            setPiece(from, PIECE_EMPTY);
+            setPiece(to, move.promotion() ? (mover < 0 ? -move.promotion() : move.promotion()) : mover);
+        }
+        setTurn(-turn);
+#ifdef CHESS_DEBUG_HASH
+        assert(hash == computeHash());
+#endif
+    }
+
+    inline void unmakeMove(Move move, const Undo& undo) {
+        const int from = move.from();
+        const int to = move.to();
+        Piece moved = pieces[to];
 
-    inline int getScore(const Player player) { return score * player; };
-    inline int getScore() { return score; };
+        if (move.isCastle()) {
+            setPiece(to, pieces[from]);
+            setPiece(from, moved);
+        } else {
+            if (move.promotion())
+                moved = moved < 0 ? -PIECE_PAWN : PIECE_PAWN;
+            setPiece(from, moved);
+            setPiece(to, undo.captured);
+        }
+        haveCastled = undo.haveCastled;
+        turn = -turn;
+        hash = undo.hash;
+#ifdef CHESS_DEBUG_HASH
+        assert(hash == computeHash());
+#endif
+    }
+
+    inline Bitboard piecesOf(Player player) const { return bitboards[playerIndex(player)][0]; };
+    inline Bitboard piecesOf(Player player, Piece type) const { return bitboards[playerIndex(player)][type]; };
+    inline Bitboard occupied() const { return bitboards[0][0] | bitboards[1][0]; };
+
+    inline int countOf(Player player) const { return pieceCounts[playerIndex(player)][0]; };
+    inline int countOf(Player player, Piece type) const { return pieceCounts[playerIndex(player)][type]; };
+    inline int totalPieces() const { return pieceCounts[0][0] + pieceCounts[1][0]; };
+
+    // anything but pawns and the king, the usual test for zugzwang prone endings
+    inline bool hasNonPawnMaterial(Player player) const {
+        const int8_t* counts = pieceCounts[playerIndex(player)];
+        return counts[PIECE_KNIGHT] + counts[PIECE_BISHOP] + counts[PIECE_ROOK] + counts[PIECE_QUEEN] > 0;
+    }
+
+    // pieces of both colors that attack index, sliders see through nothing but occupied
+    inline Bitboard attackersTo(int index, Bitboard occupied) const {
+        return (bb::pawnAttacks[1][index] & bitboards[0][PIECE_PAWN])
+            | (bb::pawnAttacks[0][index] & bitboards[1][PIECE_PAWN])
+            | (bb::knightAttacks[index] & (bitboards[0][PIECE_KNIGHT] | bitboards[1][PIECE_KNIGHT]))
+            | (bb::kingAttacks[index] & (bitboards[0][PIECE_KING] | bitboards[1][PIECE_KING]))
+            | (bb::bishopAttacks(index, occupied) & (bitboards[0][PIECE_BISHOP] | bitboards[1][PIECE_BISHOP] | bitboards[0][PIECE_QUEEN] | bitboards[1][PIECE_QUEEN]))
+            | (bb::rookAttacks(index, occupied) & (bitboards[0][PIECE_ROOK] | bitboards[1][PIECE_ROOK] | bitboards[0][PIECE_QUEEN] | bitboards[1][PIECE_QUEEN]));
+    }
+
+    inline bool isAttacked(int index, Player by, Bitboard occupied) const {
+        return (attackersTo(index, occupied) & piecesOf(by)) != 0;
+    }
+
+    inline bool inCheck(Player player) const {
+        Bitboard king = piecesOf(player, PIECE_KING);
+        return king && isAttacked(bb::lsb(king), -player, occupied());
+    }
+
+    /*
+     the middlegame and endgame scores blended by phase, extra material from
+     promotions still counts as a full middlegame
+     */
+    inline int getScore() const {
+        const int p = std::min(phase, psqt::MAX_PHASE);
+        return (mgScore * p + egScore * (psqt::MAX_PHASE - p)) / psqt::MAX_PHASE;
+    }
+    inline int getScore(const Player player) const { return getScore() * player; };
 
     inline static int getX(int index) { return index % BOARD_DIM; };
     inline static int getY(int index) { return index / BOARD_DIM; };
@@ -127,86 +344,75 @@ struct Board {
     
     void setup();
 
+    // load a position from forsyth-edwards notation, false if it is malformed
+    bool loadFEN(const std::string& fen);
+
     void print() const;
 };
 
 /*
- essentially a move in a chess game
+ what can make a move illegal for player, worked out once per node: the pieces
+ giving check, our pieces pinned to the king, and the squares a non-king move
+ must land on (everything, or the checker and the squares between it and the
+ king, or nothing in double check)
  */
-struct Move {
-    struct PiecePositionPair {
-        Piece piece;
-        Position position;
-    };
-    PiecePositionPair changes[4];
+struct CheckInfo {
+    int king; // -1 if the player has no king, then nothing is illegal
+    Bitboard checkers;
+    Bitboard pinned;
+    Bitboard evasionMask;
 
-    inline Move() {
-        changes[0].position = -1;
-    }
+    CheckInfo(Board* board, Player player);
 
-    inline Move(Board* board, int from, int to) {
-        changes[0].position = from;
-        changes[0].piece = PIECE_EMPTY;
-        changes[1].position = to;
-        changes[1].piece = board->pieceAt(from);
-        changes[2].position = -1;
-    }
+    inline bool inCheck() const { return checkers != 0; };
 
-    // used for pawn promotion
-    inline Move(Board* board, int from, int to, Piece promotion) {
-        changes[0].position = from;
-        changes[0].piece = PIECE_EMPTY;
-        changes[1].position = to;
-        changes[1].piece = promotion;
-        changes[2].position = -1;
+    // is a non-king move from -> to legal as far as pins go
+    inline bool pinAllows(int from, int to) const {
+        return !(pinned & bb::square(from)) || (bb::line[king][from] & bb::square(to));
     }
+};
 
-    inline void castle(Board* board, int from, int to) {
-        changes[0].position = from;
-        changes[0].piece = board->pieceAt(to);
-        changes[1].position = to;
-        changes[1].piece = board->pieceAt(from);
-        changes[2].position = -2;
-        if (board->pieceAt(to) > 0) {
-            changes[2].piece = (board->haveCastled | FLAG_WHITE_CASTLED);
-        } else {
-            changes[2].piece = (board->haveCastled | FLAG_BLACK_CASTLED);
-        }
-    }
+/*
+ iterate the legal moves available to the player given a board state
+ */
+template<class STORE> void generateMoves(Board* board, Player player, STORE& store);
 
-    inline void apply(Board* board) {
-        assert(changes[0].position != -1);
-        for (int i = 0; i < sizeof(changes) / sizeof(PiecePositionPair); ++i) {
-            if (changes[i].position < 0) {
-                if (changes[i].position == -2) {
-                    int8_t temp = changes[i].piece;
-                    board->haveCastled = changes[i].piece;
-                    changes[i].piece = temp;
-                }
-                break ;
-            }
-            Piece temp = board->pieceAt(changes[i].position);
-            board->setPiece(changes[i].position, changes[i].piece);
-            changes[i].piece = temp;
-        }
-    }
+/*
+ the two halves of generateMoves: captures and promotions, then the rest
+ */
+template<class STORE> void generateCaptures(Board* board, Player player, const CheckInfo& info, STORE& store);
+template<class STORE> void generateQuiets(Board* board, Player player, const CheckInfo& info, STORE& store);
 
-    std::string toString() const;
-};
+// could the generator have produced this move, for moves from the hash table
+bool isPseudoLegal(Board* board, Player player, Move move);
+bool isLegal(Board* board, Player player, Move move, const CheckInfo& info);
 
-inline std::ostream& operator << (std::ostream& o, const Move& move) {
-    o << move.toString();
-    return o;
-}
+/*
+ the original square by square generator, kept as a reference to check the
+ bitboard generator against (perft --perft-check). it is pseudo-legal,
+ moves may leave the king in check, see LegalReferenceMoves
+ */
+template<class STORE> void generateMovesReference(Board* board, Player player, STORE& store);
 
 /*
- iterate the moves available to the player given a board state
+ a store that only counts, for bulk counting the last ply of a perft
  */
-template<class STORE> void generateMoves(Board* board, Player player, STORE& store);
+struct MoveCounter {
+    uint64_t count;
+
+    MoveCounter() : count(0) { }
+
+    inline void put(const Move&) {
+        count++;
+    }
+};
+
+const int MAX_MOVES = 256;
+const int MAX_PLY = 128;
 
 struct MoveIterator {
     int moveCount;
-    Move moves[128];
+    Move moves[MAX_MOVES];
 
     MoveIterator(Board* board, Player player) {
         moveCount = 0;
@@ -214,22 +420,15 @@ struct MoveIterator {
     }
 
     void put(const Move& move) {
-        assert(moveCount <= 128);
+        assert(moveCount < MAX_MOVES);
         moves[moveCount++] = move;
     }
 
-     void sort(Board* board) {
-         /*std::sort(moves, moves + moveCount, [board](Move& move1, Move& move2) {
-             move1.apply(board);
-             int score1 = board->getScore();
-             move1.apply(board);
-             move2.apply(board);
-             int score2 = board->getScore();
-             move2.apply(board);
-
-             return score1 > score2;
-         });*/
-     }
+    // the move at index becomes the next one returned by getNext
+    void bringToFront(int index) {
+        assert(index >= 0 && index < moveCount);
+        std::swap(moves[index], moves[moveCount - 1]);
+    }
 
     bool getNext(Move& move) {
         if (moveCount == 0)
@@ -238,17 +437,248 @@ struct MoveIterator {
         return true;
     }
 };
- 
-inline bool operator == (const Move& a, const Move& b) {
-    for (int i = 0; i < 4; ++i) {
-        if (a.changes[i].position < 0 && b.changes[i].position < 0)
-            break;
 
-        if (a.changes[i].piece != b.changes[i].piece || b.changes[i].position != a.changes[i].position)
+/*
+ the reference generator's moves that pass isLegal, the same set
+ generateMoves should produce
+ */
+struct LegalReferenceMoves {
+    Board* board;
+    Player player;
+    CheckInfo info;
+    int moveCount;
+    Move moves[MAX_MOVES];
+
+    LegalReferenceMoves(Board* board, Player player) : board(board), player(player), info(board, player), moveCount(0) {
+        generateMovesReference<LegalReferenceMoves>(board, player, *this);
+    }
+
+    void put(const Move& move) {
+        assert(moveCount < MAX_MOVES);
+        if (isLegal(board, player, move, info))
+            moves[moveCount++] = move;
+    }
+
+    bool getNext(Move& move) {
+        if (moveCount == 0)
             return false;
+        move = moves[--moveCount];
+        return true;
     }
-    return true;
+};
+
+// captures, promotions and castling are not quiet
+inline bool isQuiet(const Board* board, Move move) {
+    return !move.promotion() && !move.isCastle() && board->pieceAt(move.to()) == PIECE_EMPTY;
 }
+
+/*
+ what a search has learned about quiet moves: the two most recent quiet
+ moves that caused a cutoff at every ply (killers), and how often moving a
+ piece type to a square has (history). one per search thread
+ */
+struct MoveHistory {
+    // history scores are halved once one passes this, so recent cutoffs weigh more
+    static const int HISTORY_MAX = 1 << 20;
+
+    Move killers[MAX_PLY][2];
+    int scores[2][7][BOARD_SPACES];
+
+    MoveHistory() {
+        clear();
+    }
+
+    void clear() {
+        std::fill(&killers[0][0], &killers[0][0] + MAX_PLY * 2, Move());
+        std::fill(&scores[0][0][0], &scores[0][0][0] + 2 * 7 * BOARD_SPACES, 0);
+    }
+
+    // the game moved on by plies since these were collected, ply n of the old tree is ply n - plies now
+    void advance(int plies) {
+        if (plies <= 0)
+            return ;
+        for (int ply = 0; ply < MAX_PLY; ++ply) {
+            killers[ply][0] = ply + plies < MAX_PLY ? killers[ply + plies][0] : Move();
+            killers[ply][1] = ply + plies < MAX_PLY ? killers[ply + plies][1] : Move();
+        }
+    }
+
+    inline int score(const Board* board, Move move) const {
+        const Piece piece = board->pieceAt(move.from());
+        return scores[Board::colorIndex(piece)][piece < 0 ? -piece : piece][move.to()];
+    }
+
+    // move, a quiet one, caused a cutoff at ply with remaining plies left to search
+    void cutoff(const Board* board, Move move, int ply, int remaining) {
+        if (killers[ply][0] != move) {
+            killers[ply][1] = killers[ply][0];
+            killers[ply][0] = move;
+        }
+
+        const Piece piece = board->pieceAt(move.from());
+        int& entry = scores[Board::colorIndex(piece)][piece < 0 ? -piece : piece][move.to()];
+        entry += remaining * remaining;
+        if (entry > HISTORY_MAX) {
+            for (int* s = &scores[0][0][0]; s != &scores[0][0][0] + 2 * 7 * BOARD_SPACES; ++s)
+                *s /= 2;
+        }
+    }
+};
+
+/*
+ generates moves in stages as they are asked for: the hash move first, then
+ captures and promotions best victim and cheapest attacker first (mvv-lva),
+ then the killers, then the other quiet moves by history. a cutoff on an
+ early move never pays for generating the later stages, and within a stage
+ the best move is picked out of the rest on every call instead of sorting
+ moves that may never be looked at. with capturesOnly it stops after the
+ captures, for the quiescence search. without a history the quiet moves come
+ in generation order
+ */
+struct StagedMoveIterator {
+    enum Stage {
+        STAGE_HASH_MOVE,
+        STAGE_GENERATE_CAPTURES,
+        STAGE_CAPTURES,
+        STAGE_KILLERS,
+        STAGE_GENERATE_QUIETS,
+        STAGE_QUIETS,
+        STAGE_DONE
+    };
+
+    Board* board;
+    Player player;
+    CheckInfo info;
+    Move hashMove;
+    const MoveHistory* history;
+    int ply;
+    bool capturesOnly;
+    int stage;
+    int killerIndex;
+    Move killers[2]; // the ones already returned, so the quiet stage skips them
+    int moveCount;
+    Move moves[MAX_MOVES];
+    int scores[MAX_MOVES];
+
+    StagedMoveIterator(Board* board, Player player, Move hashMove, bool capturesOnly = false, const MoveHistory* history = nullptr, int ply = 0) : board(board), player(player), info(board, player), hashMove(hashMove), history(history), ply(ply), capturesOnly(capturesOnly), stage(STAGE_HASH_MOVE), killerIndex(0), moveCount(0) {
+    }
+
+    inline bool inCheck() const { return info.inCheck(); };
+
+    void put(const Move& move) {
+        assert(moveCount < MAX_MOVES);
+        moves[moveCount++] = move;
+    }
+
+    bool getNext(Move& move) {
+        switch (stage) {
+            case STAGE_HASH_MOVE:
+                stage = STAGE_GENERATE_CAPTURES;
+                if (!hashMove.isNull() && isLegal(board, player, hashMove, info)) {
+                    move = hashMove;
+                    return true;
+                }
+                hashMove = Move();
+                // fall through
+            case STAGE_GENERATE_CAPTURES:
+                generateCaptures<StagedMoveIterator>(board, player, info, *this);
+                scoreCaptures();
+                stage = STAGE_CAPTURES;
+                // fall through
+            case STAGE_CAPTURES:
+                if (nextGenerated(move))
+                    return true;
+                if (capturesOnly) {
+                    stage = STAGE_DONE;
+                    return false;
+                }
+                stage = STAGE_KILLERS;
+                // fall through
+            case STAGE_KILLERS:
+                while (history && killerIndex < 2) {
+                    Move killer = history->killers[ply][killerIndex++];
+                    if (!killer.isNull() && killer != hashMove && killer != killers[0] && isQuiet(board, killer) && isLegal(board, player, killer, info)) {
+                        killers[killerIndex - 1] = killer;
+                        move = killer;
+                        return true;
+                    }
+                }
+                // fall through
+            case STAGE_GENERATE_QUIETS:
+                generateQuiets<StagedMoveIterator>(board, player, info, *this);
+                scoreQuiets();
+                stage = STAGE_QUIETS;
+                // fall through
+            case STAGE_QUIETS:
+                if (nextGenerated(move))
+                    return true;
+                stage = STAGE_DONE;
+                // fall through
+            default:
+                return false;
+        }
+    }
+
+private:
+    // captured value first, then the cheapest attacker. promotions count the new piece
+    void scoreCaptures() {
+        static const int attackerRank[7] = {0, 1, 2, 3, 4, 6, 5};
+        for (int i = 0; i < moveCount; ++i) {
+            const Piece victim = board->pieceAt(moves[i].to());
+            const Piece attacker = board->pieceAt(moves[i].from());
+            scores[i] = (pieceGetValue(victim < 0 ? -victim : victim) + pieceGetValue(moves[i].promotion())) * 8
+                - attackerRank[attacker < 0 ? -attacker : attacker];
+        }
+    }
+
+    void scoreQuiets() {
+        for (int i = 0; i < moveCount; ++i)
+            scores[i] = history ? history->score(board, moves[i]) : 0;
+    }
+
+    // partial selection sort, swap the best remaining move to the end and take it
+    inline bool nextGenerated(Move& move) {
+        while (moveCount > 0) {
+            int best = moveCount - 1;
+            for (int i = 0; i < moveCount - 1; ++i) {
+                if (scores[i] > scores[best])
+                    best = i;
+            }
+            move = moves[best];
+            moves[best] = moves[moveCount - 1];
+            scores[best] = scores[moveCount - 1];
+            moveCount--;
+            if (move != hashMove && move != killers[0] && move != killers[1])
+                return true;
+        }
+        return false;
+    }
+};
+
+/*
+ the moves made so far in a search with what they destroyed, make and unmake
+ go through here so a search never has to keep its own undo records
+ */
+
+struct UndoStack {
+    int size;
+    Move moves[MAX_PLY];
+    Undo undos[MAX_PLY];
+
+    UndoStack() : size(0) { }
+
+    inline void make(Board* board, Move move) {
+        assert(size < MAX_PLY);
+        moves[size] = move;
+        board->makeMove(move, undos[size++]);
+    }
+
+    inline void unmake(Board* board) {
+        assert(size > 0);
+        --size;
+        board->unmakeMove(moves[size], undos[size]);
+    }
+};
     
     
 
@@ -0,0 +1,523 @@
+#ifndef __BOOK_H_
+#define __BOOK_H_
+
+#include "board.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ the opening book: a file of fixed size entries sorted by position key, mapped
+ into memory and binary searched, so a book move costs a few cache misses
+ instead of a search. the book is built from pgn files by Builder below
+ */
+namespace book {
+    using namespace chess;
+
+    /*
+     one move seen in one position. the file is nothing but these, sorted by
+     key and then move, in the byte order of the machine that built it
+     */
+    struct Entry {
+        uint64_t key; // Board::hash
+        uint16_t move; // Move::data
+        uint16_t weight; // 2 per win and 1 per draw for the side that played it, saturates
+        uint32_t games;
+    };
+
+    inline bool operator < (const Entry& a, const Entry& b) {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    }
+
+    class Book {
+    public:
+        Book() : entries(nullptr), count(0) { }
+
+        ~Book() {
+            close();
+        }
+
+        Book(const Book&) = delete;
+        Book& operator = (const Book&) = delete;
+
+        bool open(const std::string& path) {
+            close();
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size == 0 || info.st_size % sizeof(Entry) != 0) {
+                ::close(fd);
+                return false;
+            }
+
+            void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (memory == MAP_FAILED)
+                return false;
+            madvise(memory, info.st_size, MADV_RANDOM);
+
+            entries = static_cast<const Entry*>(memory);
+            count = info.st_size / sizeof(Entry);
+            return true;
+        }
+
+        void close() {
+            if (entries)
+                munmap(const_cast<Entry*>(entries), count * sizeof(Entry));
+            entries = nullptr;
+            count = 0;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        /*
+         a book move for the side to move, picked at random by weight. false
+         if the position is not in the book or none of its moves are legal
+         here (a different position with the same key)
+         */
+        bool probe(Board& board, Move& move) const {
+            if (!entries)
+                return false;
+
+            const Entry* first = std::lower_bound(entries, entries + count, Entry{board.hash, 0, 0, 0});
+            const Entry* last = first;
+            uint32_t total = 0;
+            while (last != entries + count && last->key == board.hash)
+                total += (last++)->weight;
+            if (total == 0)
+                return false;
+
+            thread_local std::mt19937 random(std::random_device{}());
+            uint32_t pick = std::uniform_int_distribution<uint32_t>(0, total - 1)(random);
+            const Entry* chosen = first;
+            while (pick >= chosen->weight)
+                pick -= (chosen++)->weight;
+
+            Move candidate;
+            candidate.data = chosen->move;
+            MoveIterator iter(&board, board.turn);
+            Move legal;
+            while (iter.getNext(legal)) {
+                if (legal == candidate) {
+                    move = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        const Entry* entries;
+        size_t count;
+    };
+
+    /*
+     the legal move written in standard algebraic notation ("Nbd7", "exd5",
+     "e8=Q+"), a null move if there is none or it is ambiguous. castling and
+     en passant are never matched: the board does not play them the way pgn
+     means them, so a game is only followed up to the first of either
+     */
+    inline Move parseSan(Board& board, std::string san) {
+        while (!san.empty() && std::strchr("+#!?", san.back()))
+            san.pop_back();
+        if (san.size() < 2 || san[0] == 'O' || san[0] == '0')
+            return Move();
+
+        Piece piece = PIECE_PAWN;
+        switch (san[0]) {
+            case 'N': piece = PIECE_KNIGHT; break;
+            case 'B': piece = PIECE_BISHOP; break;
+            case 'R': piece = PIECE_ROOK; break;
+            case 'Q': piece = PIECE_QUEEN; break;
+            case 'K': piece = PIECE_KING; break;
+        }
+        if (piece != PIECE_PAWN)
+            san.erase(0, 1);
+
+        Piece promotion = 0;
+        const size_t equals = san.find('=');
+        if (equals != std::string::npos) {
+            if (equals + 1 >= san.size())
+                return Move();
+            promotion = san[equals + 1];
+            san.erase(equals);
+        } else if (piece == PIECE_PAWN && std::strchr("NBRQ", san.back())) {
+            promotion = san.back();
+            san.pop_back();
+        }
+        switch (promotion) {
+            case 'N': promotion = PIECE_KNIGHT; break;
+            case 'B': promotion = PIECE_BISHOP; break;
+            case 'R': promotion = PIECE_ROOK; break;
+            case 'Q': promotion = PIECE_QUEEN; break;
+            case 0: break;
+            default: return Move();
+        }
+
+        if (san.size() < 2)
+            return Move();
+        const int toX = san[san.size() - 2] - 'a', toY = san[san.size() - 1] - '1';
+        if (toX < 0 || toX >= BOARD_DIM || toY < 0 || toY >= BOARD_DIM)
+            return Move();
+        const int to = Board::toIndex(toX, toY);
+
+        // whatever is left is the capture mark and the file and/or rank the piece comes from
+        int fromX = -1, fromY = -1;
+        for (size_t i = 0; i + 2 < san.size(); ++i) {
+            if (san[i] >= 'a' && san[i] <= 'h')
+                fromX = san[i] - 'a';
+            else if (san[i] >= '1' && san[i] <= '8')
+                fromY = san[i] - '1';
+            else if (san[i] != 'x')
+                return Move();
+        }
+
+        Move found;
+        MoveIterator iter(&board, board.turn);
+        Move move;
+        while (iter.getNext(move)) {
+            const Piece moving = board.pieceAt(move.from());
+            if (move.isCastle() || move.to() != to || move.promotion() != promotion || (moving < 0 ? -moving : moving) != piece)
+                continue ;
+            if ((fromX >= 0 && Board::getX(move.from()) != fromX) || (fromY >= 0 && Board::getY(move.from()) != fromY))
+                continue ;
+            if (!found.isNull())
+                return Move();
+            found = move;
+        }
+        return found;
+    }
+
+    /*
+     reads pgn a character at a time and hands back one game at a time: the
+     tags it cares about, the moves of the main line and the result. comments,
+     variations and annotation glyphs are skipped, so memory is one game no
+     matter how big the file is
+     */
+    class PgnReader {
+    public:
+        struct Game {
+            std::string fen; // from a FEN tag, empty for the start position
+            std::vector<std::string> moves;
+            std::string result; // 1-0, 0-1, 1/2-1/2 or *
+        };
+
+        PgnReader(std::istream& in) : in(in) { }
+
+        bool next(Game& game) {
+            game = Game();
+            bool any = false;
+            std::string token;
+            int variations = 0;
+
+            int c;
+            while ((c = in.get()) != EOF) {
+                if (!std::isspace(c) && !std::strchr(".{;()[", c) && !(c == '%' && atLineStart)) {
+                    token += (char) c;
+                    atLineStart = false;
+                    continue ;
+                }
+
+                // any delimiter ends the token in hand, before a variation or comment starts
+                if (endToken(token, variations, game, any)) {
+                    in.unget();
+                    return true;
+                }
+
+                if (c == '{') {
+                    while ((c = in.get()) != EOF && c != '}') { }
+                } else if (c == ';' || c == '%') {
+                    std::string rest;
+                    std::getline(in, rest);
+                    c = '\n';
+                } else if (c == '[' && variations == 0) {
+                    // a game that ended without a result
+                    if (!game.moves.empty()) {
+                        in.unget();
+                        return true;
+                    }
+                    std::string tag;
+                    while ((c = in.get()) != EOF && c != ']')
+                        tag += (char) c;
+                    readTag(tag, game);
+                    any = true;
+                } else if (c == '(') {
+                    variations++;
+                } else if (c == ')') {
+                    variations = std::max(0, variations - 1);
+                }
+                atLineStart = c == '\n';
+            }
+            endToken(token, variations, game, any);
+            return any;
+        }
+
+    private:
+        std::istream& in;
+        bool atLineStart = true;
+
+        void readTag(const std::string& tag, Game& game) {
+            const size_t quote = tag.find('"');
+            const size_t end = tag.rfind('"');
+            if (quote == std::string::npos || end <= quote)
+                return ;
+            std::string name = tag.substr(0, quote);
+            name.erase(std::remove_if(name.begin(), name.end(), ::isspace), name.end());
+            if (name == "FEN")
+                game.fen = tag.substr(quote + 1, end - quote - 1);
+        }
+
+        // true once the token was the result that ends the game
+        bool endToken(std::string& token, int variations, Game& game, bool& any) {
+            if (token.empty())
+                return false;
+            std::string word;
+            word.swap(token);
+            if (variations > 0 || word[0] == '$' || std::isdigit(word[0]) || word[0] == '*') {
+                if (variations == 0 && (word == "1-0" || word == "0-1" || word == "1/2-1/2" || word == "*")) {
+                    game.result = word;
+                    return true;
+                }
+                return false; // move numbers, glyphs and anything inside a variation
+            }
+            game.moves.push_back(word);
+            any = true;
+            return false;
+        }
+    };
+
+    /*
+     builds a book from pgn without holding it all in memory: entries are
+     collected in a buffer of at most memoryMegabytes, every full buffer is
+     sorted, merged and written out as a run next to the book, and the runs
+     are merged into the book at the end. positions are recorded for the
+     first maxPlies plies of every game, moves played in fewer than minGames
+     games are left out. a file that cannot be opened, read or written
+     throws, and no partial book is left behind
+     */
+    class Builder {
+    public:
+        Builder(const std::string& path, int maxPlies, size_t memoryMegabytes, uint32_t minGames) : path(path), maxPlies(maxPlies), minGames(std::max<uint32_t>(1, minGames)), games(0), skipped(0), positions(0) {
+            capacity = std::max<size_t>(1024, memoryMegabytes * 1024 * 1024 / sizeof(Entry));
+        }
+
+        ~Builder() {
+            for (auto& run : runs)
+                remove(run.c_str());
+        }
+
+        Builder(const Builder&) = delete;
+        Builder& operator = (const Builder&) = delete;
+
+        void addPgn(std::istream& in) {
+            PgnReader reader(in);
+            PgnReader::Game game;
+            while (reader.next(game))
+                addGame(game);
+        }
+
+        // write the book, the number of entries in it
+        size_t finish() {
+            std::sort(buffer.begin(), buffer.end());
+            combine(buffer);
+
+            FILE* out = fopen(path.c_str(), "wb");
+            if (!out)
+                throw std::runtime_error("could not write " + path);
+            size_t written = 0;
+            try {
+                if (runs.empty()) {
+                    for (auto& entry : buffer)
+                        written += write(out, entry);
+                } else {
+                    spill();
+                    written = merge(out);
+                }
+            } catch (...) {
+                fclose(out);
+                remove(path.c_str());
+                throw;
+            }
+            if (fclose(out) != 0) {
+                remove(path.c_str());
+                throw std::runtime_error("could not write " + path);
+            }
+            return written;
+        }
+
+        uint64_t gameCount() const { return games; };
+        uint64_t skippedGames() const { return skipped; }; // could not be set up at all
+        uint64_t positionCount() const { return positions; };
+
+    private:
+        const std::string path;
+        const int maxPlies;
+        const uint32_t minGames;
+        size_t capacity;
+        std::vector<Entry> buffer;
+        std::vector<std::string> runs;
+        uint64_t games;
+        uint64_t skipped;
+        uint64_t positions;
+
+        void addGame(const PgnReader::Game& game) {
+            Board board;
+            if (game.fen.empty()) {
+                board.setup();
+            } else if (!board.loadFEN(game.fen)) {
+                skipped++;
+                return ;
+            }
+            games++;
+
+            // what a move is worth to the side that played it, by the result
+            const int whiteWeight = game.result == "1-0" ? 2 : (game.result == "0-1" ? 0 : 1);
+            for (int ply = 0; ply < maxPlies && ply < (int) game.moves.size(); ++ply) {
+                const Move move = parseSan(board, game.moves[ply]);
+                if (move.isNull())
+                    break ;
+
+                const uint16_t weight = (uint16_t) (board.turn > 0 ? whiteWeight : 2 - whiteWeight);
+                add(Entry{board.hash, move.data, weight, 1});
+
+                Undo undo;
+                board.makeMove(move, undo);
+            }
+        }
+
+        void add(const Entry& entry) {
+            positions++;
+            // grow by hand so the buffer never goes past capacity
+            if (buffer.size() == buffer.capacity())
+                buffer.reserve(std::min(capacity, std::max<size_t>(1024, buffer.size() * 2)));
+            buffer.push_back(entry);
+            if (buffer.size() < capacity)
+                return ;
+
+            std::sort(buffer.begin(), buffer.end());
+            combine(buffer);
+            // a buffer that hardly shrank is worth writing out
+            if (buffer.size() > capacity / 2)
+                spill();
+        }
+
+        static bool same(const Entry& a, const Entry& b) {
+            return a.key == b.key && a.move == b.move;
+        }
+
+        static void accumulate(Entry& into, const Entry& from) {
+            into.weight = (uint16_t) std::min<uint32_t>(UINT16_MAX, (uint32_t) into.weight + from.weight);
+            into.games += from.games;
+        }
+
+        // merge neighbouring entries for the same move, entries must be sorted
+        static void combine(std::vector<Entry>& entries) {
+            size_t out = 0;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (out > 0 && same(entries[out - 1], entries[i]))
+                    accumulate(entries[out - 1], entries[i]);
+                else
+                    entries[out++] = entries[i];
+            }
+            entries.resize(out);
+        }
+
+        void spill() {
+            const std::string run = path + ".run" + std::to_string(runs.size());
+            FILE* out = fopen(run.c_str(), "wb");
+            if (!out)
+                throw std::runtime_error("could not write " + run);
+            // the destructor removes it, written or not
+            runs.push_back(run);
+            const bool written = fwrite(buffer.data(), sizeof(Entry), buffer.size(), out) == buffer.size();
+            if (fclose(out) != 0 || !written)
+                throw std::runtime_error("could not write " + run);
+            buffer.clear();
+        }
+
+        size_t write(FILE* out, const Entry& entry) {
+            if (entry.games < minGames)
+                return 0;
+            if (fwrite(&entry, sizeof(Entry), 1, out) != 1)
+                throw std::runtime_error("could not write " + path);
+            return 1;
+        }
+
+        // the runs being merged, closed however the merge ends
+        struct RunFiles {
+            std::vector<FILE*> files;
+
+            ~RunFiles() {
+                for (FILE* file : files)
+                    fclose(file);
+            }
+        };
+
+        // k-way merge of the sorted runs into out
+        size_t merge(FILE* out) {
+            RunFiles runFiles;
+            std::vector<FILE*>& files = runFiles.files;
+            for (auto& run : runs) {
+                FILE* file = fopen(run.c_str(), "rb");
+                if (!file)
+                    throw std::runtime_error("could not read " + run);
+                files.push_back(file);
+            }
+
+            typedef std::pair<Entry, size_t> Head;
+            auto later = [](const Head& a, const Head& b) { return b.first < a.first; };
+            std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+            Entry entry;
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (fread(&entry, sizeof(Entry), 1, files[i]) == 1)
+                    heads.push(Head(entry, i));
+            }
+
+            size_t written = 0;
+            bool pending = false;
+            Entry current;
+            while (!heads.empty()) {
+                Head head = heads.top();
+                heads.pop();
+                if (fread(&entry, sizeof(Entry), 1, files[head.second]) == 1)
+                    heads.push(Head(entry, head.second));
+
+                if (pending && same(current, head.first)) {
+                    accumulate(current, head.first);
+                } else {
+                    if (pending)
+                        written += write(out, current);
+                    current = head.first;
+                    pending = true;
+                }
+            }
+            if (pending)
+                written += write(out, current);
+
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (ferror(files[i]))
+                    throw std::runtime_error("could not read " + runs[i]);
+            }
+            return written;
+        }
+    };
+}
+
+#endif
@@ -1,6 +1,13 @@
 #include "board.h"
 #include "smartness.h"
 #include "benchmarking.h"
+#include "perft.h"
+#include "ybwc.h"
+#include "ponder.h"
+#include "session.h"
+#include "book.h"
+#include "tablebase.h"
+#include "statistics.h"
 #include "include/server-http.hpp"
 
 #include <stdio.h>
@@ -17,31 +24,121 @@ using namespace boost::property_tree;
 
 
 /*
- utility to make a move given a chess board and the player
+ shared by every search, sized once in main before any search runs
  */
-void makemove(chess::Board* board, chess::Player player) {
+smartness::TranspositionTable transpositionTable;
+smartness::EngineContext engine(&transpositionTable);
+smartness::Ponderers ponderers(engine);
+
+// probed before every search, empty unless --book is given
+book::Book openingBook;
+
+// endgame tables from --tablebases, the search probes them through engine.tablebases
+tablebase::Tablebases tablebases;
+
+// every search findmove runs, served at /stats
+smartness::Statistics statistics;
+
+
+/*
+ search for the player's move, the board is left alone. context defaults to
+ the shared engine, history carries killers and history between searches
+ */
+smartness::SearchResult findmove(chess::Board* board, chess::Player player, const smartness::EngineContext& context = engine, chess::MoveHistory* history = nullptr) {
     std::cout << "computing moves for player: " << player << std::endl;
+    
+    benchmarking::Timer timer;
+    chess::Move bookMove;
+    if (openingBook.probe(*board, bookMove)) {
+        smartness::SearchResult result = smartness::SearchResult();
+        result.line.push_back(bookMove);
+        result.elapsed = timer.elapsedMicroseconds();
+        std::cout << "\tbook move " << bookMove << " (" << result.elapsed << " us)" << std::endl;
+        statistics.bookHit();
+        return result;
+    }
+    
     std::cout << "begin iterative deepening... " << std::endl;
     
-    benchmarking::Benchmark benchmark;
+    context.table->newSearch();
     
-    std::vector<chess::Move> moves;
-    for (int i = 2; i <= 7; ++i) {
-        benchmark.push();
-        smartness::MinimaxAlphaBeta minimax(board, player, i, moves);
-        moves = std::vector<chess::Move>();
-        minimax.getMoveVector(moves);
-        std::cout << "\tdepth " << i << "(" << benchmark.pop() << " us): ";
-        for (auto& move : moves) {
+    // the search works on its own copy, board is only touched by the final move
+    smartness::SearchResult result = smartness::think(context, *board, player, [](const smartness::SearchResult& result) {
+        std::cout << "\tdepth " << result.depth << "(" << result.elapsed << " us, " << result.nodes << " nodes): ";
+        for (auto& move : result.line) {
             std::cout << move << " - ";
         }
         std::cout << std::endl;
+    }, nullptr, history);
+    const smartness::SearchStats& stats = result.stats;
+    std::cout << "\tnull window " << stats.nullWindowSearches << " re-searched " << stats.researches
+        << ", cutoffs " << stats.betaCutoffs << " on the first move " << stats.firstMoveCutoffs
+        << ", aspiration fail low " << stats.aspirationFailLows << " high " << stats.aspirationFailHighs << std::endl;
+    std::cout << "\tnull move cutoffs " << stats.nullMoveCutoffs << " refuted by verification " << stats.nullMoveVerifyFails
+        << ", reduced " << stats.reductions << " re-searched " << stats.reductionResearches
+        << ", tablebase hits " << stats.tablebaseHits << std::endl;
+    std::cout << "\thash hits " << stats.hashHits << " of " << stats.hashProbes << " probes, " << stats.hashCutoffs << " cut off"
+        << ", evaluations " << stats.evaluations << ", branching " << result.branching() << std::endl;
+    statistics.record(result);
+    return result;
+}
+
+/*
+ play the first move of a search result, false if there is none
+ */
+bool playmove(chess::Board* board, chess::Player player, const smartness::SearchResult& result) {
+    if (result.line.empty()) {
+        std::cout << (board->inCheck(player) ? "checkmate" : "stalemate") << ", no moves to make" << std::endl;
+        return false;
     }
     
-    chess::Move move = moves[0];
-    move.apply(board);
+    chess::Undo undo;
+    board->makeMove(result.line[0], undo);
     
     board->print();
+    return true;
+}
+
+/*
+ the move /ai plays: answered from the ponder if the opponent played the
+ reply we expected, then ponder the reply we expect to this move. false
+ once the player has no legal move left
+ */
+bool aimove(chess::Board* board, chess::Player player, smartness::Ponderer& ponderer) {
+    smartness::SearchResult result;
+    smartness::SearchResult pondered;
+    if (ponderer.take(*board, player, pondered)) {
+        std::cout << "\tponder hit, depth " << pondered.depth << " after " << pondered.elapsed << " us" << std::endl;
+        statistics.ponderHit();
+        if (smartness::ponderCovers(engine, pondered)) {
+            result = pondered;
+            statistics.record(result);
+        } else {
+            // short of the normal budget, search on from the table the ponder filled
+            result = findmove(board, player);
+            if (result.depth < pondered.depth)
+                result = pondered;
+        }
+    } else {
+        result = findmove(board, player);
+    }
+    if (!playmove(board, player, result))
+        return false;
+    
+    const chess::Move reply = smartness::expectedReply(engine, *board, result);
+    if (!reply.isNull()) {
+        std::cout << "\tpondering " << reply << std::endl;
+        ponderer.start(*board, player, reply);
+    }
+    return true;
+}
+
+/*
+ utility to make a move given a chess board and the player, false once the
+ player has no legal move left
+ */
+bool makemove(chess::Board* board, chess::Player player) {
+    return playmove(board, player, findmove(board, player));
 }
 
 
@@ -55,44 +152,693 @@ int mode_test() {
     
     chess::Move move;
     
-    while (true) {
+    while (makemove(&board, 1) && makemove(&board, -1)) {
+        
+    }
+    return 0;
+}
+
+/*
+ ponder [fen], plays the /ai move for the side to move in the position (or
+ the start) and checks that a ponder started after it. --ponder sets how
+ long, a second by default
+ */
+int mode_ponder(const std::vector<std::string>& args) {
+    std::string fen;
+    for (size_t i = 1; i < args.size(); ++i)
+        fen += (i > 1 ? " " : "") + args[i];
+    
+    chess::Board board;
+    if (fen.empty()) {
+        board.setup();
+    } else if (!board.loadFEN(fen)) {
+        std::cerr << "could not parse fen: " << fen << std::endl;
+        return 1;
+    }
+    
+    if (engine.ponderTime <= 0)
+        engine.ponderTime = 1000;
+    smartness::Ponderer ponderer(engine);
+    if (!aimove(&board, board.turn, ponderer)) {
+        std::cerr << "no move to play" << std::endl;
+        return 1;
+    }
+    if (!ponderer.pondering()) {
+        std::cerr << "ponder check: failed, no ponder started" << std::endl;
+        return 1;
+    }
+    ponderer.cancel();
+    std::cout << "ponder check: ok" << std::endl;
+    return 0;
+}
+
+/*
+ perft <depth> [fen], counts the move tree from the position (or the start).
+ with check the counts are compared against the reference generator
+ */
+int mode_perft(const std::vector<std::string>& args, size_t hashMegabytes, bool check) {
+    int depth = 0;
+    std::string fen;
+    if (args.size() > 1) {
+        depth = atoi(args[1].c_str());
+        for (size_t i = 2; i < args.size(); ++i)
+            fen += (i > 2 ? " " : "") + args[i];
+    } else {
+        std::cout << "please enter depth and optionally a fen: " << std::endl;
+        std::cin >> depth;
+        std::getline(std::cin, fen);
+    }
+    
+    if (depth < 1) {
+        std::cerr << "perft depth must be at least 1" << std::endl;
+        return 1;
+    }
+    
+    chess::Board board;
+    if (fen.find_first_not_of(' ') == std::string::npos) {
+        board.setup();
+    } else if (!board.loadFEN(fen)) {
+        std::cerr << "could not parse fen: " << fen << std::endl;
+        return 1;
+    }
+    board.print();
+    
+    std::unique_ptr<perft::HashTable> table;
+    if (hashMegabytes > 0)
+        table.reset(new perft::HashTable(hashMegabytes));
+    
+    std::cout << "perft " << depth << (table ? " (hashed)" : "") << std::endl;
+    perft::divide(&board, depth, table.get());
+    if (check && !perft::check(&board, depth))
+        return 1;
+    return 0;
+}
+
+/*
+ smp [threads] [depth], searches the start position with 1, 2, 4 ... threads
+ and reports the time to every depth and the nodes per second, to see how
+ lazy smp scales
+ */
+int mode_smp(const std::vector<std::string>& args) {
+    int maxThreads = args.size() > 1 ? atoi(args[1].c_str()) : std::max(1, (int) std::thread::hardware_concurrency());
+    int depth = args.size() > 2 ? atoi(args[2].c_str()) : engine.maxDepth;
+    if (maxThreads < 1 || depth < engine.minDepth) {
+        std::cerr << "usage: smp [threads] [depth]" << std::endl;
+        return 1;
+    }
+    
+    chess::Board board;
+    board.setup();
+    
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        transpositionTable.clear();
+        transpositionTable.newSearch();
+        smartness::EngineContext context = engine;
+        context.threads = threads;
         
-        makemove(&board, 1);
-        makemove(&board, -1);
+        std::cout << "threads " << threads << std::endl;
+        benchmarking::Timer timer;
+        smartness::LazySmp search(context, board, 1);
+        for (int i = context.minDepth; i <= depth; ++i) {
+            std::vector<chess::Move> moves = search.main.search(i);
+            std::cout << "\tdepth " << i << " " << timer.elapsedMilliseconds() << " ms " << (moves.empty() ? chess::Move() : moves[0]) << std::endl;
+        }
+        const int64_t elapsed = timer.elapsedMicroseconds();
+        search.finish();
+        std::cout << "\tnodes " << search.nodes() << " nodes/sec " << benchmarking::perSecond(search.nodes(), elapsed) << std::endl;
         
+        if (threads == maxThreads)
+            break ;
     }
+    return 0;
+}
+
+/*
+ ybwc [threads] [depth] [deterministic] [fen], the split point search with
+ 1, 2, 4 ... threads, next to mode_smp so the two can be compared. with
+ deterministic every thread count must report the same tree nodes, score
+ and move, see ybwc::Search
+ */
+int mode_ybwc(const std::vector<std::string>& args) {
+    int maxThreads = args.size() > 1 ? atoi(args[1].c_str()) : std::max(1, (int) std::thread::hardware_concurrency());
+    int depth = args.size() > 2 ? atoi(args[2].c_str()) : engine.maxDepth;
+    size_t next = 3;
+    bool deterministic = args.size() > next && args[next] == "deterministic";
+    if (deterministic)
+        next++;
+    std::string fen;
+    for (size_t i = next; i < args.size(); ++i)
+        fen += (i > next ? " " : "") + args[i];
+    
+    if (maxThreads < 1 || depth < 1) {
+        std::cerr << "usage: ybwc [threads] [depth] [deterministic] [fen]" << std::endl;
+        return 1;
+    }
+    
+    chess::Board board;
+    if (fen.empty()) {
+        board.setup();
+    } else if (!board.loadFEN(fen)) {
+        std::cerr << "could not parse fen: " << fen << std::endl;
+        return 1;
+    }
+    
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        transpositionTable.clear();
+        transpositionTable.newSearch();
+        
+        std::cout << "threads " << threads << (deterministic ? " (deterministic, no table, not comparable to the normal search)" : "") << std::endl;
+        smartness::ybwc::Search search(engine, threads, deterministic);
+        benchmarking::Timer timer;
+        for (int i = 1; i <= depth; ++i) {
+            chess::Move bestMove;
+            int score = search.run(board, board.turn, i, bestMove);
+            std::cout << "\tdepth " << i << " " << timer.elapsedMilliseconds() << " ms " << bestMove << " score " << score << std::endl;
+        }
+        const int64_t elapsed = timer.elapsedMicroseconds();
+        std::cout << "\tnodes " << search.nodes() << " tree nodes " << search.treeNodes() << " nodes/sec " << benchmarking::perSecond(search.nodes(), elapsed)
+            << " evaluations " << search.evaluations() << " splits " << search.splits() << " steals " << search.steals() << " cancelled " << search.cancelledTasks() << std::endl;
+        
+        if (threads == maxThreads)
+            break ;
+    }
+    return 0;
+}
+
+/*
+ book <out> <pgn>..., builds an opening book from pgn files ("-" reads
+ stdin), see book.h. plies, memory and minGames come from --book-plies,
+ --book-memory and --book-min
+ */
+struct BookOptions {
+    int plies = 20;
+    size_t memoryMegabytes = 256;
+    uint32_t minGames = 1;
+};
+
+int mode_book(const std::vector<std::string>& args, const BookOptions& options) {
+    if (args.size() < 3) {
+        std::cerr << "usage: book <out> <pgn>..." << std::endl;
+        return 1;
+    }
+    
+    benchmarking::Timer timer;
+    try {
+        book::Builder builder(args[1], options.plies, options.memoryMegabytes, options.minGames);
+        for (size_t i = 2; i < args.size(); ++i) {
+            if (args[i] == "-") {
+                builder.addPgn(std::cin);
+                continue ;
+            }
+            std::ifstream in(args[i]);
+            if (!in) {
+                std::cerr << "could not open " << args[i] << std::endl;
+                return 1;
+            }
+            std::cout << "reading " << args[i] << std::endl;
+            builder.addPgn(in);
+        }
+        
+        const size_t entries = builder.finish();
+        std::cout << "games " << builder.gameCount() << " (skipped " << builder.skippedGames() << "), positions "
+            << builder.positionCount() << ", book entries " << entries << " in " << timer.elapsedMilliseconds() << " ms" << std::endl;
+    }
+    catch(exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ tablebase <dir> [signature]..., generates endgame tables into dir with
+ threads threads, with what they depend on. no signature means every table
+ of 3 men, "all" every table of 3 and 4 men
+ */
+int mode_tablebase(const std::vector<std::string>& args, int threads) {
+    if (args.size() < 2) {
+        std::cerr << "usage: tablebase <dir> [signature]..." << std::endl;
+        return 1;
+    }
+    
+    std::vector<std::string> names(args.begin() + 2, args.end());
+    if (names.empty())
+        names = {"KQK", "KRK", "KBK", "KNK", "KPK"};
+    else if (names.size() == 1 && names[0] == "all")
+        names = tablebase::Signature::all();
+    
+    benchmarking::Timer timer;
+    try {
+        tablebase::Generator generator(args[1], threads);
+        for (auto& name : names)
+            generator.generate(name);
+    }
+    catch(exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "done in " << timer.elapsedMilliseconds() << " ms on " << threads << " threads" << std::endl;
+    return 0;
+}
+
+/*
+ the bench positions: openings, middlegames full of tactics, and endgames
+ from king and pawn races to a bare rook mate. castling rights and en passant
+ squares are ignored like everywhere else
+ */
+const char* const BENCH_POSITIONS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "rnbqkb1r/ppp1pppp/5n2/3p4/3P4/2N5/PPP1PPPP/R1BQKBNR w KQkq - 2 3",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+    "rq3rk1/ppp2ppp/1bnpb3/3N2B1/3NP3/7P/PPPQ1PP1/2KR3R w - - 7 14",
+    "r1bq1r1k/1pp1n1pp/1p1p4/4p2Q/4Pp2/1BNP4/PPP2PPP/3R1RK1 w - - 2 14",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+    "4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+    "2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+    "r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+    "3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+    "r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18",
+    "4k2r/1pb2ppp/1p2p3/1R1p4/3P4/2r1PN2/P4PPP/1R4K1 b - - 3 22",
+    "3q2k1/pb3p1p/4pbp1/2r5/PpN2N2/1P2P2P/5PP1/Q2R2K1 b - - 4 26",
+    "r3k2r/3nnpbp/q2pp1p1/p7/Pp1PPPP1/4BNN1/1P5P/R2Q1RK1 w kq - 0 16",
+    "3Qb1k1/1r2ppb1/pN1n2q1/Pp1Pp1Pr/4P2p/4BP2/4B1R1/1R5K b - - 11 40",
+    "4k3/3q1r2/1N2r1b1/3ppN2/2nPP3/1B1R2n1/2R1Q3/3K4 w - - 5 1",
+    "5rk1/q6p/2p3bR/1pPp1rP1/1P1Pp3/P3B1Q1/1K3P2/R7 w - - 93 90",
+    "4rrk1/1p1nq3/p7/2p1P1pp/3P2bp/3Q1Bn1/PPPB4/1K2R1NR w - - 40 21",
+    "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - - 0 1",
+    "6k1/4pp1p/3p2p1/P1pPb3/R7/1r2P1PP/3B1P2/6K1 w - - 0 1",
+    "6k1/6p1/P6p/r1N5/5p2/7P/1b3PP1/4R1K1 w - - 0 1",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "3b4/5kp1/1p1p1p1p/pP1PpP1P/P1P1P3/3KN3/8/8 w - - 0 1",
+    "2K5/p7/7P/5pR1/8/5k2/r7/8 w - - 0 1",
+    "8/6pk/1p6/8/PP3p1p/5P2/4KP1q/3Q4 w - - 0 1",
+    "7k/3p2pp/4q3/8/4Q3/5Kp1/P6b/8 w - - 0 1",
+    "8/2p5/8/2kPKp1p/2p4P/2P5/3P4/8 w - - 0 1",
+    "8/1p3pp1/7p/5P1P/2k3P1/8/2K2P2/8 w - - 0 1",
+    "8/pp2r1k1/2p1p3/3pP2p/1P1P1P1P/P5KR/8/8 w - - 0 1",
+    "8/3p4/p1bk3p/Pp6/1Kp1PpPp/2P2P1P/2P5/5B2 b - - 0 1",
+    "5k2/7R/4P2p/5K2/p1r2P1p/8/8/8 b - - 0 1",
+    "8/3p3B/5p2/5P2/p7/PP5b/k7/6K1 w - - 0 1",
+    "8/8/1p1r1k2/p1pPN1p1/P3KnP1/1P6/8/3R4 b - - 0 1",
+    "8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - - 0 1",
+    "8/8/8/4k3/8/8/8/R3K3 w - - 0 1",
+};
+
+/*
+ bench [depth], searches every bench position to depth and prints the total
+ nodes and the speed. the node count is a signature of the search: it is the
+ same on every machine and build until the search itself changes. the bench
+ has its own table, one thread and no book or tablebases, so no option
+ changes the signature
+ */
+int mode_bench(const std::vector<std::string>& args) {
+    const int BENCH_DEPTH = 11;
+    const size_t BENCH_HASH_MEGABYTES = 16;
+    
+    const int depth = args.size() > 1 ? atoi(args[1].c_str()) : BENCH_DEPTH;
+    if (depth < 1 || depth > smartness::MAX_DEPTH) {
+        std::cerr << "usage: bench [depth]" << std::endl;
+        return 1;
+    }
+    
+    smartness::TranspositionTable table;
+    table.resize(BENCH_HASH_MEGABYTES);
+    smartness::EngineContext context(&table);
+    
+    const int count = sizeof(BENCH_POSITIONS) / sizeof(BENCH_POSITIONS[0]);
+    uint64_t nodes = 0;
+    benchmarking::Timer timer;
+    for (int i = 0; i < count; ++i) {
+        chess::Board board;
+        if (!board.loadFEN(BENCH_POSITIONS[i])) {
+            std::cerr << "could not parse bench position " << BENCH_POSITIONS[i] << std::endl;
+            return 1;
+        }
+        table.clear();
+        table.newSearch();
+        
+        // plain iterations, think would stop on the clock and make the count depend on the machine
+        std::unique_ptr<smartness::SearchWorker> worker(new smartness::SearchWorker(context, board, board.turn));
+        std::vector<chess::Move> line;
+        for (int d = std::min(context.minDepth, depth); d <= depth; ++d)
+            line = worker->search(d);
+        nodes += worker->nodes;
+        
+        std::cout << "position " << i + 1 << "/" << count << ": " << worker->nodes << " nodes, best "
+            << (line.empty() ? chess::Move() : line[0]) << std::endl;
+    }
+    
+    const int64_t elapsed = timer.elapsedMicroseconds();
+    std::cout << "===========================" << std::endl;
+    std::cout << "depth       : " << depth << std::endl;
+    std::cout << "total time  : " << elapsed / 1000 << " ms" << std::endl;
+    std::cout << "nodes       : " << nodes << std::endl;
+    std::cout << "nodes/second: " << benchmarking::perSecond(nodes, elapsed) << std::endl;
+    return 0;
 }
 
 typedef SimpleWeb::Server<SimpleWeb::HTTP> HttpServer;
 
-int mode_webui(int port);
+/*
+ limits for the games kept by the web api, see session.h
+ */
+struct SessionOptions {
+    size_t hashMegabytes = 8; // transposition table per game
+    size_t memoryMegabytes = 256; // for all games together
+    int64_t ttlSeconds = 30 * 60; // games idle for longer are dropped
+};
+
+int mode_webui(int port, int threads, const SessionOptions& sessionOptions);
 
 
 /*
  main entry point
  */
 int main(int argc, char* argv[]) {
-    std::cout << "please enter mode (web or test): " << std::endl;
+    size_t hashMegabytes = 64;
+    size_t perftHashMegabytes = 0;
+    bool perftCheck = false;
+    int httpThreads = 4;
+    bool depthGiven = false;
+    bool threadsGiven = false;
+    std::string tablebasePath;
+    SessionOptions sessionOptions;
+    BookOptions bookOptions;
+    std::string bookPath;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--hash" && i + 1 < argc)
+            hashMegabytes = atoi(argv[++i]);
+        else if (arg == "--perft-hash" && i + 1 < argc)
+            perftHashMegabytes = atoi(argv[++i]);
+        else if (arg == "--perft-check")
+            perftCheck = true;
+        else if (arg == "--threads" && i + 1 < argc) {
+            engine.threads = std::max(1, atoi(argv[++i]));
+            threadsGiven = true;
+        }
+        else if (arg == "--movetime" && i + 1 < argc)
+            engine.moveTime = std::max(0, atoi(argv[++i]));
+        else if (arg == "--nodes" && i + 1 < argc)
+            engine.nodeLimit = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--depth" && i + 1 < argc) {
+            engine.maxDepth = std::min(std::max(engine.minDepth, atoi(argv[++i])), smartness::MAX_DEPTH);
+            depthGiven = true;
+        }
+        else if (arg == "--ponder" && i + 1 < argc)
+            engine.ponderTime = std::max(0, atoi(argv[++i]));
+        else if (arg == "--http-threads" && i + 1 < argc)
+            httpThreads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--session-hash" && i + 1 < argc)
+            sessionOptions.hashMegabytes = std::max(1, atoi(argv[++i]));
+        else if (arg == "--session-memory" && i + 1 < argc)
+            sessionOptions.memoryMegabytes = std::max(1, atoi(argv[++i]));
+        else if (arg == "--session-ttl" && i + 1 < argc)
+            sessionOptions.ttlSeconds = std::max(1, atoi(argv[++i]));
+        else if (arg == "--tablebases" && i + 1 < argc)
+            tablebasePath = argv[++i];
+        else if (arg == "--book" && i + 1 < argc)
+            bookPath = argv[++i];
+        else if (arg == "--book-plies" && i + 1 < argc)
+            bookOptions.plies = std::max(1, atoi(argv[++i]));
+        else if (arg == "--book-memory" && i + 1 < argc)
+            bookOptions.memoryMegabytes = std::max(1, atoi(argv[++i]));
+        else if (arg == "--book-min" && i + 1 < argc)
+            bookOptions.minGames = std::max(1, atoi(argv[++i]));
+        else
+            args.push_back(arg);
+    }
+    
+    // with a budget the clock decides how deep to go
+    if ((engine.moveTime || engine.nodeLimit) && !depthGiven)
+        engine.maxDepth = smartness::MAX_DEPTH;
+    
+    transpositionTable.resize(hashMegabytes);
+    std::cout << "transposition table: " << transpositionTable.sizeInBytes() / (1024 * 1024) << " MB, search threads: " << engine.threads << std::endl;
+    
+    if (!bookPath.empty()) {
+        if (openingBook.open(bookPath))
+            std::cout << "opening book: " << openingBook.size() << " entries" << std::endl;
+        else
+            std::cerr << "could not open book " << bookPath << std::endl;
+    }
+    
+    if (!tablebasePath.empty()) {
+        std::cout << "tablebases: " << tablebases.open(tablebasePath) << " tables, up to " << tablebases.maxMen() << " men" << std::endl;
+        if (tablebases.size() > 0)
+            engine.tablebases = &tablebases;
+    }
     
     std::string mode;
-    std::cin >> mode;
+    if (args.size() > 0) {
+        mode = args[0];
+    } else {
+        std::cout << "please enter mode (web, test, perft, ponder, smp, ybwc, book, tablebase or bench): " << std::endl;
+        std::cin >> mode;
+    }
     
     if (mode == "test") {
         mode_test();
     } else if (mode == "web") {
-        mode_webui(8080);
+        mode_webui(8080, httpThreads, sessionOptions);
+    } else if (mode == "perft") {
+        return mode_perft(args, perftHashMegabytes, perftCheck);
+    } else if (mode == "ponder") {
+        return mode_ponder(args);
+    } else if (mode == "smp") {
+        return mode_smp(args);
+    } else if (mode == "ybwc") {
+        return mode_ybwc(args);
+    } else if (mode == "book") {
+        return mode_book(args, bookOptions);
+    } else if (mode == "bench") {
+        return mode_bench(args);
+    } else if (mode == "tablebase") {
+        // generating is all the machine does, so use every core unless told otherwise
+        return mode_tablebase(args, threadsGiven ? engine.threads : std::max(1, (int) std::thread::hardware_concurrency()));
     } else {
         std::cerr << "no such mode!" << std::endl;
     }
 }
 
 
-int mode_webui(int port) {
+/*
+ the board as the web ui writes it, {"e2": "wP", ...}
+ */
+ptree positionTree(const chess::Board& board) {
+    ptree tree;
+    for (int i = 0; i < chess::BOARD_SPACES; ++i) {
+        if (board.pieceAt(i) == chess::PIECE_EMPTY) continue ;
+        
+        std::stringstream posStream;
+        posStream << (char) (chess::Board::getX(i) + 'a') << (char) (chess::Board::getY(i) + '1');
+        std::string posStr = posStream.str();
+        
+        std::stringstream pieceStream;
+        pieceStream << (board.pieceAt(i) < 0 ? 'b' : 'w') << chess::pieceGetLetter(board.pieceAt(i));
+        std::string pieceStr = pieceStream.str();
+        
+        tree.put(posStr, pieceStr);
+    }
+    return tree;
+}
+
+void sendJson(HttpServer::Response& response, const std::string& status, const ptree& tree) {
+    std::stringstream out;
+    write_json(out, tree);
+    std::string outStr = out.str();
+    
+    response << "HTTP/1.1 " << status << "\r\nContent-Length: " << outStr.length() << "\r\n\r\n" << outStr;
+}
+
+void sendError(HttpServer::Response& response, const std::string& status, const std::string& message) {
+    std::cout << "\t" << status << ": " << message << std::endl;
+    response << "HTTP/1.1 " << status << "\r\nContent-Length: " << message.length() << "\r\n\r\n" << message;
+}
+
+// the request's json, an empty tree if it has no body
+ptree readOptionalJson(const shared_ptr<HttpServer::Request>& request) {
+    ptree pt;
+    std::string content = request->content.string();
+    if (content.find_first_not_of(" \t\r\n") != std::string::npos) {
+        std::stringstream in(content);
+        read_json(in, pt);
+    }
+    return pt;
+}
+
+/*
+ where a session's game stands, what every session request answers with
+ */
+ptree sessionTree(const smartness::Session& session, chess::Move reply) {
+    chess::Board board = session.board;
+    chess::MoveIterator iter(&board, board.turn);
+    
+    ptree tree;
+    tree.put("id", session.id);
+    tree.put("turn", board.turn < 0 ? "black" : "white");
+    tree.put("move", reply.isNull() ? "" : reply.toLongAlgebraic());
+    tree.put("ply", session.moves.size());
+    if (iter.moveCount > 0)
+        tree.put("status", "playing");
+    else
+        tree.put("status", board.inCheck(board.turn) ? "checkmate" : "stalemate");
+    tree.put_child("position", positionTree(board));
+    return tree;
+}
+
+/*
+ the totals of every search so far, see statistics.h
+ */
+ptree statisticsTree(const smartness::Statistics::Totals& totals) {
+    const smartness::SearchStats& stats = totals.stats;
+    ptree tree;
+    tree.put("uptime_ms", totals.uptime / 1000);
+    tree.put("searches", totals.searches);
+    tree.put("book_hits", totals.bookHits);
+    tree.put("ponder_hits", totals.ponderHits);
+    tree.put("nodes", totals.nodes);
+    tree.put("search_time_us", totals.elapsed);
+    tree.put("nodes_per_second", benchmarking::perSecond(totals.nodes, totals.elapsed));
+    tree.put("average_depth", totals.searches ? (double) totals.depthSum / totals.searches : 0);
+    tree.put("effective_branching_factor", totals.branchingCount ? totals.branchingSum / totals.branchingCount : 0);
+    tree.put("evaluations", stats.evaluations);
+    tree.put("tablebase_hits", stats.tablebaseHits);
+    
+    tree.put("cutoffs.beta", stats.betaCutoffs);
+    tree.put("cutoffs.first_move", stats.firstMoveCutoffs);
+    tree.put("cutoffs.first_move_rate", stats.betaCutoffs ? (double) stats.firstMoveCutoffs / stats.betaCutoffs : 0);
+    tree.put("cutoffs.null_move", stats.nullMoveCutoffs);
+    tree.put("cutoffs.null_move_verify_fails", stats.nullMoveVerifyFails);
+    
+    tree.put("hash.probes", stats.hashProbes);
+    tree.put("hash.hits", stats.hashHits);
+    tree.put("hash.cutoffs", stats.hashCutoffs);
+    tree.put("hash.hit_rate", stats.hashProbes ? (double) stats.hashHits / stats.hashProbes : 0);
+    
+    tree.put("windows.null_window_searches", stats.nullWindowSearches);
+    tree.put("windows.researches", stats.researches);
+    tree.put("windows.aspiration_fail_lows", stats.aspirationFailLows);
+    tree.put("windows.aspiration_fail_highs", stats.aspirationFailHighs);
+    tree.put("windows.reductions", stats.reductions);
+    tree.put("windows.reduction_researches", stats.reductionResearches);
+    
+    // the main search thread's iterations only, see Statistics::Depth
+    ptree depths;
+    for (size_t i = 0; i < totals.depths.size(); ++i) {
+        const smartness::Statistics::Depth& depth = totals.depths[i];
+        if (depth.iterations == 0) continue ;
+        ptree entry;
+        entry.put("depth", i);
+        entry.put("iterations", depth.iterations);
+        entry.put("nodes", depth.nodes);
+        entry.put("average_us", depth.elapsed / (int64_t) depth.iterations);
+        entry.put("nodes_per_second", benchmarking::perSecond(depth.nodes, depth.elapsed));
+        depths.push_back(std::make_pair("", entry));
+    }
+    tree.add_child("depths", depths);
+    return tree;
+}
+
+int mode_webui(int port, int threads, const SessionOptions& sessionOptions) {
     std::cout << "Chess AI by Gareth George" << std::endl;
-    std::cout << "\tweb interface loading. port: " << port << std::endl;
+    std::cout << "\tweb interface loading. port: " << port << " threads: " << threads << std::endl;
+    
+    /*
+     every request to /ai builds its own board and searches it with its own
+     worker, the threads only share the lockless transposition table
+     */
+    HttpServer server(port, threads);
+    
+    /*
+     games that live on the server, a request sends only the move played.
+     POST /session {"fen": optional} starts one, POST /session/<id>/move
+     {"move": "e2e4"} plays the move (if any) and answers with the engine's
+     reply, DELETE /session/<id> ends it
+     */
+    smartness::SessionStore sessions(engine, sessionOptions.hashMegabytes, sessionOptions.memoryMegabytes, sessionOptions.ttlSeconds);
+    std::cout << "\tsessions: " << sessionOptions.hashMegabytes << " MB each, at most " << sessions.maxSessions()
+        << ", idle timeout " << sessionOptions.ttlSeconds << " s" << std::endl;
+    
+    server.resource["^/session$"]["POST"]=[&sessions](HttpServer::Response& response, shared_ptr<HttpServer::Request> request) {
+        std::cout << "got request to /session" << std::endl;
+        try {
+            ptree pt = readOptionalJson(request);
+            
+            chess::Board board;
+            std::string fen = pt.get<string>("fen", "");
+            if (fen.empty()) {
+                board.setup();
+            } else if (!board.loadFEN(fen)) {
+                sendError(response, "400 Bad Request", "could not parse fen: " + fen);
+                return ;
+            }
+            
+            std::shared_ptr<smartness::Session> session = sessions.create(board);
+            std::lock_guard<std::mutex> lock(session->mutex);
+            std::cout << "\tcreated session " << session->id << std::endl;
+            sendJson(response, "200 OK", sessionTree(*session, chess::Move()));
+        }
+        catch(exception& e) {
+            sendError(response, "400 Bad Request", e.what());
+        }
+    };
     
-    //HTTP-server at port 8080 using 4 threads
-    HttpServer server(8080, 4);
+    server.resource["^/session/([0-9a-f]+)/move$"]["POST"]=[&sessions](HttpServer::Response& response, shared_ptr<HttpServer::Request> request) {
+        const std::string id = request->path_match[1];
+        std::cout << "got request to /session/" << id << "/move" << std::endl;
+        try {
+            std::shared_ptr<smartness::Session> session = sessions.find(id);
+            if (!session) {
+                sendError(response, "404 Not Found", "no such session: " + id);
+                return ;
+            }
+            
+            ptree pt = readOptionalJson(request);
+            
+            std::lock_guard<std::mutex> lock(session->mutex);
+            chess::Board& board = session->board;
+            
+            // no move asks the engine to play the side to move
+            std::string name = pt.get<string>("move", "");
+            if (!name.empty()) {
+                chess::Move move = session->parse(name);
+                if (move.isNull()) {
+                    sendError(response, "400 Bad Request", "illegal move: " + name);
+                    return ;
+                }
+                session->play(move);
+                std::cout << "\tplayed " << move << std::endl;
+            }
+            
+            chess::Move reply;
+            const chess::Player player = board.turn;
+            smartness::SearchResult result = findmove(&board, player, session->context, &session->warmHistory());
+            if (!result.line.empty()) {
+                reply = result.line[0];
+                session->play(reply);
+                board.print();
+            }
+            sendJson(response, "200 OK", sessionTree(*session, reply));
+        }
+        catch(exception& e) {
+            sendError(response, "400 Bad Request", e.what());
+        }
+    };
+    
+    server.resource["^/session/([0-9a-f]+)$"]["DELETE"]=[&sessions](HttpServer::Response& response, shared_ptr<HttpServer::Request> request) {
+        const std::string id = request->path_match[1];
+        if (sessions.remove(id))
+            response << "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+        else
+            sendError(response, "404 Not Found", "no such session: " + id);
+    };
     
     server.resource["^/ai$"]["POST"]=[](HttpServer::Response& response, shared_ptr<HttpServer::Request> request) {
         std::cout << "got request to /ai" << std::endl;
@@ -150,37 +896,23 @@ int mode_webui(int port) {
                 
                 board.setPiece(chess::Board::toIndex(x, y), piece);
             }
+            board.setTurn(currentTurn);
             
             /*
              make a move!
              */
             board.print();
             
-            makemove(&board, currentTurn);
+            /*
+             answer from the ponder if the opponent played the reply we
+             expected, then ponder the reply we expect to this move
+             */
+            aimove(&board, currentTurn, *ponderers.get(request->remote_endpoint_address));
             
             /*
              feed it back
              */
-            ptree resTree;
-            for (int i = 0; i < chess::BOARD_SPACES; ++i) {
-                if (board.pieceAt(i) == chess::PIECE_EMPTY) continue ;
-                
-                std::stringstream posStream;
-                posStream << (char) (chess::Board::getX(i) + 'a') << (char) (chess::Board::getY(i) + '1');
-                std::string posStr = posStream.str();
-                
-                std::stringstream pieceStream;
-                pieceStream << (board.pieceAt(i) < 0 ? 'b' : 'w') << chess::pieceGetLetter(board.pieceAt(i));
-                std::string pieceStr = pieceStream.str();
-                
-                resTree.put(posStr, pieceStr);
-            }
-            
-            std::stringstream out;
-            write_json(out, resTree);
-            std::string outStr = out.str();
-            
-            response << "HTTP/1.1 200 OK\r\nContent-Length: " << outStr.length() << "\r\n\r\n" << outStr;
+            sendJson(response, "200 OK", positionTree(board));
         }
         catch(exception& e) {
             std::cout << e.what() << std::endl;
@@ -188,6 +920,13 @@ int mode_webui(int port) {
         }
     };
     
+    server.resource["^/stats$"]["GET"]=[&sessions](HttpServer::Response& response, shared_ptr<HttpServer::Request>) {
+        ptree tree = statisticsTree(statistics.snapshot());
+        tree.put("sessions.live", sessions.size());
+        tree.put("sessions.max", sessions.maxSessions());
+        sendJson(response, "200 OK", tree);
+    };
+    
     server.default_resource["GET"]=[](HttpServer::Response& response, shared_ptr<HttpServer::Request> request) {
         const auto web_root_path=boost::filesystem::canonical("web");
         boost::filesystem::path path=web_root_path;
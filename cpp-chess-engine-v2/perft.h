@@ -0,0 +1,168 @@
+#ifndef __PERFT_H_
+#define __PERFT_H_
+
+#include "board.h"
+#include "benchmarking.h"
+#include <stdint.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ perft, counts the leaf nodes of the move tree to a fixed depth. the counts
+ check the move generator and make/unmake, the speed is our benchmark for them
+ */
+namespace perft {
+    using namespace chess;
+
+    /*
+     subtree counts keyed by position and depth, always replace
+     */
+    struct HashTable {
+        struct Entry {
+            uint64_t key;
+            uint64_t count;
+            int depth;
+        };
+        std::vector<Entry> entries;
+
+        HashTable(size_t megabytes) {
+            size_t count = 1;
+            while (count * 2 * sizeof(Entry) <= megabytes * 1024 * 1024)
+                count *= 2;
+            entries.resize(count, Entry{0, 0, 0});
+        }
+
+        inline Entry& at(uint64_t key) {
+            return entries[key & (entries.size() - 1)];
+        }
+    };
+
+    inline uint64_t count(Board* board, int depth, HashTable* table) {
+        if (depth == 0)
+            return 1;
+
+        // bulk count the last ply, no need to make the moves
+        if (depth == 1) {
+            MoveCounter counter;
+            generateMoves<MoveCounter>(board, board->turn, counter);
+            return counter.count;
+        }
+
+        if (table) {
+            HashTable::Entry& entry = table->at(board->hash);
+            if (entry.key == board->hash && entry.depth == depth)
+                return entry.count;
+        }
+
+        uint64_t nodes = 0;
+        Move move;
+        Undo undo;
+        MoveIterator iter(board, board->turn);
+        while (iter.getNext(move)) {
+            board->makeMove(move, undo);
+            nodes += count(board, depth - 1, table);
+            board->unmakeMove(move, undo);
+        }
+
+        if (table) {
+            HashTable::Entry& entry = table->at(board->hash);
+            entry.key = board->hash;
+            entry.depth = depth;
+            entry.count = nodes;
+        }
+        return nodes;
+    }
+
+    /*
+     perft with the count of every root move printed, for diffing against
+     another engine to find the broken line
+     */
+    inline uint64_t divide(Board* board, int depth, HashTable* table) {
+        benchmarking::Timer timer;
+        uint64_t nodes = 0;
+
+        Move move;
+        Undo undo;
+        MoveIterator iter(board, board->turn);
+        while (depth > 0 && iter.getNext(move)) {
+            board->makeMove(move, undo);
+            uint64_t moveNodes = count(board, depth - 1, table);
+            board->unmakeMove(move, undo);
+
+            std::cout << move.toLongAlgebraic() << ": " << moveNodes << std::endl;
+            nodes += moveNodes;
+        }
+
+        int64_t elapsed = timer.elapsedMicroseconds();
+        std::cout << std::endl;
+        std::cout << "nodes: " << nodes << std::endl;
+        std::cout << "time: " << elapsed / 1000 << " ms" << std::endl;
+        std::cout << "nodes/sec: " << benchmarking::perSecond(nodes, elapsed) << std::endl;
+        return nodes;
+    }
+
+    /*
+     count with the reference generator filtered through isLegal instead,
+     no bulk counting and no table so nothing is shared with count
+     */
+    inline uint64_t countReference(Board* board, int depth) {
+        if (depth == 0)
+            return 1;
+
+        uint64_t nodes = 0;
+        Move move;
+        Undo undo;
+        LegalReferenceMoves iter(board, board->turn);
+        while (iter.getNext(move)) {
+            board->makeMove(move, undo);
+            nodes += countReference(board, depth - 1);
+            board->unmakeMove(move, undo);
+        }
+        return nodes;
+    }
+
+    /*
+     perft every root move with both generators and print the moves they
+     disagree on, true if they agree everywhere
+     */
+    inline bool check(Board* board, int depth) {
+        std::map<std::string, uint64_t> generated;
+        std::map<std::string, uint64_t> reference;
+
+        Move move;
+        Undo undo;
+        MoveIterator iter(board, board->turn);
+        while (iter.getNext(move)) {
+            board->makeMove(move, undo);
+            generated[move.toLongAlgebraic()] = count(board, depth - 1, nullptr);
+            board->unmakeMove(move, undo);
+        }
+        LegalReferenceMoves referenceIter(board, board->turn);
+        while (referenceIter.getNext(move)) {
+            board->makeMove(move, undo);
+            reference[move.toLongAlgebraic()] = countReference(board, depth - 1);
+            board->unmakeMove(move, undo);
+        }
+
+        bool agree = generated.size() == reference.size();
+        for (auto& entry : generated) {
+            auto found = reference.find(entry.first);
+            if (found == reference.end() || found->second != entry.second) {
+                std::cout << "mismatch " << entry.first << ": " << entry.second << " generated, "
+                    << (found == reference.end() ? 0 : found->second) << " reference" << std::endl;
+                agree = false;
+            }
+        }
+        for (auto& entry : reference) {
+            if (!generated.count(entry.first))
+                std::cout << "mismatch " << entry.first << ": 0 generated, " << entry.second << " reference" << std::endl;
+        }
+
+        std::cout << "reference check: " << (agree ? "ok" : "failed") << std::endl;
+        return agree;
+    }
+}
+
+#endif
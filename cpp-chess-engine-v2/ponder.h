@@ -0,0 +1,192 @@
+#ifndef __PONDER_H_
+#define __PONDER_H_
+
+#include "board.h"
+#include "smartness.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace smartness {
+    using namespace chess;
+
+    /*
+     thinks on the opponent's time. after we move, the reply our search
+     expects is played on a copy of the board and that position is searched
+     in the background for up to context.ponderTime. if the opponent does
+     play it the result is handed over, any other position throws the ponder
+     away. one ponder at a time, starting a new one cancels the old
+     */
+    class Ponderer {
+    public:
+        Ponderer(const EngineContext& context) : context(context), stop(false), active(false) { }
+
+        ~Ponderer() {
+            cancel();
+        }
+
+        Ponderer(const Ponderer&) = delete;
+        Ponderer& operator = (const Ponderer&) = delete;
+
+        /*
+         position is the board after our move, player is us
+         */
+        void start(const Board& position, Player player, Move expected) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finish();
+            if (context.ponderTime <= 0 || expected.isNull())
+                return ;
+
+            Undo undo;
+            board = position;
+            board.makeMove(expected, undo);
+            this->player = player;
+            result = SearchResult();
+            stop.store(false, std::memory_order_relaxed);
+            active = true;
+
+            // no newSearch, the table is shared with every client's searches, the ponder belongs to the search before it
+            thread = std::thread([this] {
+                EngineContext ponderContext = context;
+                ponderContext.moveTime = context.ponderTime;
+                ponderContext.nodeLimit = 0;
+                ponderContext.maxDepth = MAX_DEPTH;
+                result = think(ponderContext, board, this->player, [](const SearchResult&) { }, &stop);
+            });
+        }
+
+        /*
+         stop pondering, true with the ponder's result if position (with
+         player to move next for us) is the one that was pondered
+         */
+        bool take(const Board& position, Player player, SearchResult& found) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!active)
+                return false;
+            finish();
+
+            const bool hit = position.hash == board.hash && player == this->player
+                && std::equal(position.pieces, position.pieces + BOARD_SPACES, board.pieces);
+            if (!hit || result.line.empty())
+                return false;
+            found = result;
+            return true;
+        }
+
+        void cancel() {
+            std::lock_guard<std::mutex> lock(mutex);
+            finish();
+        }
+
+        bool pondering() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return active;
+        }
+
+    private:
+        const EngineContext& context;
+        std::mutex mutex; // guards everything below against concurrent requests
+        std::atomic<bool> stop;
+        bool active;
+        std::thread thread;
+
+        // the pondered position and what came of it, only read once the thread is joined
+        Board board;
+        Player player;
+        SearchResult result;
+
+        void finish() {
+            if (!active)
+                return ;
+            stop.store(true, std::memory_order_relaxed);
+            thread.join();
+            active = false;
+        }
+    };
+
+    /*
+     the reply we expect to our move, position is the board after it: the
+     second move of our line, or the table's move when the line stops there
+     (a table hit, a book move). a null move if there is none
+     */
+    inline Move expectedReply(const EngineContext& context, Board& position, const SearchResult& result) {
+        if (result.line.size() > 1)
+            return result.line[1];
+
+        TranspositionTable::Entry entry;
+        if (!context.table || !context.table->probe(position.hash, entry) || entry.move.isNull())
+            return Move();
+        const CheckInfo info(&position, position.turn);
+        return isLegal(&position, position.turn, entry.move, info) ? entry.move : Move();
+    }
+
+    /*
+     true if a ponder result already goes as far as a normal search under
+     context's budgets would, otherwise the position should be searched again
+     on the table the ponder left behind, which gets deeper for the same cost
+     */
+    inline bool ponderCovers(const EngineContext& context, const SearchResult& result) {
+        if (context.moveTime > 0)
+            return result.elapsed >= context.moveTime * 1000;
+        if (context.nodeLimit > 0)
+            return result.nodes >= context.nodeLimit;
+        return result.depth >= context.maxDepth;
+    }
+
+    /*
+     a Ponderer per client, so two players do not cancel each other's
+     ponder. at most MAX_CLIENTS ponder at once, a new client past that
+     takes the place of the one that was served longest ago
+     */
+    class Ponderers {
+    public:
+        static const size_t MAX_CLIENTS = 8;
+
+        Ponderers(const EngineContext& context) : context(context) { }
+
+        Ponderers(const Ponderers&) = delete;
+        Ponderers& operator = (const Ponderers&) = delete;
+
+        std::shared_ptr<Ponderer> get(const std::string& client) {
+            std::shared_ptr<Ponderer> evicted; // cancelled outside the lock
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto now = std::chrono::steady_clock::now();
+            auto found = ponderers.find(client);
+            if (found != ponderers.end()) {
+                found->second.lastUsed = now;
+                return found->second.ponderer;
+            }
+
+            if (ponderers.size() >= MAX_CLIENTS) {
+                auto oldest = ponderers.begin();
+                for (auto it = ponderers.begin(); it != ponderers.end(); ++it) {
+                    if (it->second.lastUsed < oldest->second.lastUsed)
+                        oldest = it;
+                }
+                evicted = oldest->second.ponderer;
+                ponderers.erase(oldest);
+            }
+
+            std::shared_ptr<Ponderer> ponderer = std::make_shared<Ponderer>(context);
+            ponderers[client] = Entry{ponderer, now};
+            return ponderer;
+        }
+
+    private:
+        struct Entry {
+            std::shared_ptr<Ponderer> ponderer;
+            std::chrono::steady_clock::time_point lastUsed;
+        };
+
+        const EngineContext& context;
+        std::mutex mutex; // guards ponderers
+        std::map<std::string, Entry> ponderers;
+    };
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef __PSQT_H_
+#define __PSQT_H_
+
+#include <stdint.h>
+#include "bitboard.h"
+
+namespace chess {
+
+/*
+ piece-square tables in centipawns, one set for the middlegame and one for
+ the endgame. the board blends the two by how much material is left
+ */
+namespace psqt {
+
+    // game phase each piece type is worth, the opening totals MAX_PHASE
+    constexpr int phaseWeights[7] = {0, 0, 1, 1, 2, 0, 4};
+    constexpr int MAX_PHASE = 24;
+
+    namespace detail {
+        // indexed by piece type: -, pawn, knight, bishop, rook, king, queen
+        constexpr int mgMaterial[7] = {0, 82, 337, 365, 477, 0, 1025};
+        constexpr int egMaterial[7] = {0, 94, 281, 297, 512, 0, 936};
+
+        /*
+         written as seen from white, rank 8 on the first row and a1 in the
+         bottom left corner, so a white piece on square s reads entry s ^ 56
+         */
+        constexpr int mgTables[7][64] = {
+            {0},
+            { // pawn
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                 50,  50,  50,  50,  50,  50,  50,  50,
+                 10,  10,  20,  30,  30,  20,  10,  10,
+                  5,   5,  10,  25,  25,  10,   5,   5,
+                  0,   0,   0,  20,  20,   0,   0,   0,
+                  5,  -5, -10,   0,   0, -10,  -5,   5,
+                  5,  10,  10, -20, -20,  10,  10,   5,
+                  0,   0,   0,   0,   0,   0,   0,   0
+            },
+            { // knight
+                -50, -40, -30, -30, -30, -30, -40, -50,
+                -40, -20,   0,   0,   0,   0, -20, -40,
+                -30,   0,  10,  15,  15,  10,   0, -30,
+                -30,   5,  15,  20,  20,  15,   5, -30,
+                -30,   0,  15,  20,  20,  15,   0, -30,
+                -30,   5,  10,  15,  15,  10,   5, -30,
+                -40, -20,   0,   5,   5,   0, -20, -40,
+                -50, -40, -30, -30, -30, -30, -40, -50
+            },
+            { // bishop
+                -20, -10, -10, -10, -10, -10, -10, -20,
+                -10,   0,   0,   0,   0,   0,   0, -10,
+                -10,   0,   5,  10,  10,   5,   0, -10,
+                -10,   5,   5,  10,  10,   5,   5, -10,
+                -10,   0,  10,  10,  10,  10,   0, -10,
+                -10,  10,  10,  10,  10,  10,  10, -10,
+                -10,   5,   0,   0,   0,   0,   5, -10,
+                -20, -10, -10, -10, -10, -10, -10, -20
+            },
+            { // rook
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                  5,  10,  10,  10,  10,  10,  10,   5,
+                 -5,   0,   0,   0,   0,   0,   0,  -5,
+                 -5,   0,   0,   0,   0,   0,   0,  -5,
+                 -5,   0,   0,   0,   0,   0,   0,  -5,
+                 -5,   0,   0,   0,   0,   0,   0,  -5,
+                 -5,   0,   0,   0,   0,   0,   0,  -5,
+                  0,   0,   0,   5,   5,   0,   0,   0
+            },
+            { // king, tucked away behind its pawns
+                -30, -40, -40, -50, -50, -40, -40, -30,
+                -30, -40, -40, -50, -50, -40, -40, -30,
+                -30, -40, -40, -50, -50, -40, -40, -30,
+                -30, -40, -40, -50, -50, -40, -40, -30,
+                -20, -30, -30, -40, -40, -30, -30, -20,
+                -10, -20, -20, -20, -20, -20, -20, -10,
+                 20,  20,   0,   0,   0,   0,  20,  20,
+                 20,  30,  10,   0,   0,  10,  30,  20
+            },
+            { // queen
+                -20, -10, -10,  -5,  -5, -10, -10, -20,
+                -10,   0,   0,   0,   0,   0,   0, -10,
+                -10,   0,   5,   5,   5,   5,   0, -10,
+                 -5,   0,   5,   5,   5,   5,   0,  -5,
+                  0,   0,   5,   5,   5,   5,   0,  -5,
+                -10,   5,   5,   5,   5,   5,   0, -10,
+                -10,   0,   5,   0,   0,   0,   0, -10,
+                -20, -10, -10,  -5,  -5, -10, -10, -20
+            }
+        };
+
+        constexpr int egTables[7][64] = {
+            {0},
+            { // pawn, the closer to promotion the better
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                 80,  80,  80,  80,  80,  80,  80,  80,
+                 50,  50,  50,  50,  50,  50,  50,  50,
+                 30,  30,  30,  30,  30,  30,  30,  30,
+                 15,  15,  15,  15,  15,  15,  15,  15,
+                  5,   5,   5,   5,   5,   5,   5,   5,
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                  0,   0,   0,   0,   0,   0,   0,   0
+            },
+            { // knight
+                -50, -40, -30, -30, -30, -30, -40, -50,
+                -40, -20,   0,   0,   0,   0, -20, -40,
+                -30,   0,  10,  15,  15,  10,   0, -30,
+                -30,   5,  15,  20,  20,  15,   5, -30,
+                -30,   0,  15,  20,  20,  15,   0, -30,
+                -30,   5,  10,  15,  15,  10,   5, -30,
+                -40, -20,   0,   5,   5,   0, -20, -40,
+                -50, -40, -30, -30, -30, -30, -40, -50
+            },
+            { // bishop
+                -20, -10, -10, -10, -10, -10, -10, -20,
+                -10,   0,   0,   0,   0,   0,   0, -10,
+                -10,   0,   5,  10,  10,   5,   0, -10,
+                -10,   0,  10,  10,  10,  10,   0, -10,
+                -10,   0,  10,  10,  10,  10,   0, -10,
+                -10,   0,   5,  10,  10,   5,   0, -10,
+                -10,   0,   0,   0,   0,   0,   0, -10,
+                -20, -10, -10, -10, -10, -10, -10, -20
+            },
+            { // rook
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                 10,  10,  10,  10,  10,  10,  10,  10,
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                  0,   0,   0,   0,   0,   0,   0,   0,
+                  0,   0,   0,   0,   0,   0,   0,   0
+            },
+            { // king, out in the middle once the queens are gone
+                -50, -40, -30, -20, -20, -30, -40, -50,
+                -30, -20, -10,   0,   0, -10, -20, -30,
+                -30, -10,  20,  30,  30,  20, -10, -30,
+                -30, -10,  30,  40,  40,  30, -10, -30,
+                -30, -10,  30,  40,  40,  30, -10, -30,
+                -30, -10,  20,  30,  30,  20, -10, -30,
+                -30, -30,   0,   0,   0,   0, -30, -30,
+                -50, -30, -30, -30, -30, -30, -30, -50
+            },
+            { // queen
+                -20, -10, -10,  -5,  -5, -10, -10, -20,
+                -10,   0,   5,   5,   5,   5,   0, -10,
+                -10,   5,  10,  10,  10,  10,   5, -10,
+                 -5,   5,  10,  15,  15,  10,   5,  -5,
+                 -5,   5,  10,  15,  15,  10,   5,  -5,
+                -10,   5,  10,  10,  10,  10,   5, -10,
+                -10,   0,   5,   5,   5,   5,   0, -10,
+                -20, -10, -10,  -5,  -5, -10, -10, -20
+            }
+        };
+
+        /*
+         material plus position, signed from white's point of view and indexed
+         by color (0 = white), piece type and square
+         */
+        constexpr bb::Table<bb::Table<bb::Table<int16_t, 64>, 7>, 2> buildTable(const int (&material)[7], const int (&tables)[7][64]) {
+            bb::Table<bb::Table<bb::Table<int16_t, 64>, 7>, 2> table = {};
+            for (int type = 1; type < 7; ++type) {
+                for (int index = 0; index < 64; ++index) {
+                    table.values[0].values[type].values[index] = (int16_t) (material[type] + tables[type][index ^ 56]);
+                    table.values[1].values[type].values[index] = (int16_t) -(material[type] + tables[type][index]);
+                }
+            }
+            return table;
+        }
+    }
+
+    constexpr bb::Table<bb::Table<bb::Table<int16_t, 64>, 7>, 2> mg = detail::buildTable(detail::mgMaterial, detail::mgTables);
+    constexpr bb::Table<bb::Table<bb::Table<int16_t, 64>, 7>, 2> eg = detail::buildTable(detail::egMaterial, detail::egTables);
+}
+
+};
+
+#endif
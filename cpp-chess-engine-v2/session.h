@@ -0,0 +1,181 @@
+#ifndef __SESSION_H_
+#define __SESSION_H_
+
+#include "board.h"
+#include "transposition.h"
+#include "smartness.h"
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace smartness {
+    using namespace chess;
+
+    /*
+     one game played through the web api. the board, the moves so far and the
+     search tables stay alive between requests, so a request only carries the
+     move that was played and the search starts warm from the last one
+     */
+    struct Session {
+        std::string id; // set by the store as it goes in, fixed from then on
+        std::mutex mutex; // one request at a time, guards everything below
+
+        Board board;
+        std::vector<Move> moves; // played since the session was created
+        TranspositionTable table;
+        EngineContext context; // the engine's options on this session's table
+        MoveHistory history; // killers and history from the last search
+        size_t searchedAt; // moves.size() when history was collected
+
+        Session(const EngineContext& engine, const Board& position, size_t hashMegabytes) : board(position), context(engine), searchedAt(0) {
+            table.resize(hashMegabytes);
+            context.table = &table;
+        }
+
+        Session(const Session&) = delete;
+        Session& operator = (const Session&) = delete;
+
+        /*
+         play a legal move for the side to move (from parse or a search), the
+         caller holds mutex
+         */
+        void play(Move move) {
+            Undo undo;
+            board.makeMove(move, undo);
+            moves.push_back(move);
+        }
+
+        /*
+         the legal move for the side to move written as long algebraic
+         ("e2e4", "e7e8q"), a null move if there is none
+         */
+        Move parse(const std::string& name) {
+            MoveIterator iter(&board, board.turn);
+            Move move;
+            while (iter.getNext(move)) {
+                if (move.toLongAlgebraic() == name)
+                    return move;
+            }
+            return Move();
+        }
+
+        // the killers are by ply from the root, line them up with the game as it is now
+        MoveHistory& warmHistory() {
+            history.advance((int) (moves.size() - searchedAt));
+            searchedAt = moves.size();
+            return history;
+        }
+    };
+
+    /*
+     the live sessions. each one costs its table plus a few kilobytes, the
+     store holds as many as fit under the memory cap and drops the least
+     recently used when a new one does not fit. sessions idle for longer than
+     the ttl are dropped whenever the store is touched. a request that still
+     holds a dropped session finishes with it, it just cannot be found again
+     */
+    class SessionStore {
+    public:
+        SessionStore(const EngineContext& engine, size_t hashMegabytes, size_t memoryMegabytes, int64_t ttlSeconds) : engine(engine), hashMegabytes(hashMegabytes), ttl(std::chrono::seconds(ttlSeconds)), random(std::random_device()()) {
+            const size_t footprint = hashMegabytes * 1024 * 1024 + sizeof(Session);
+            capacity = std::max<size_t>(1, memoryMegabytes * 1024 * 1024 / footprint);
+        }
+
+        SessionStore(const SessionStore&) = delete;
+        SessionStore& operator = (const SessionStore&) = delete;
+
+        std::shared_ptr<Session> create(const Board& position) {
+            // allocating and clearing the table takes a while, keep it out of the lock
+            std::shared_ptr<Session> session = std::make_shared<Session>(engine, position, hashMegabytes);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            expire();
+            while (sessions.size() >= capacity)
+                evictOldest();
+
+            do {
+                session->id = newId();
+            } while (sessions.count(session->id));
+
+            sessions[session->id] = Entry{session, std::chrono::steady_clock::now()};
+            return session;
+        }
+
+        // nullptr if there is no such session or it has expired
+        std::shared_ptr<Session> find(const std::string& id) {
+            std::lock_guard<std::mutex> lock(mutex);
+            expire();
+            auto found = sessions.find(id);
+            if (found == sessions.end())
+                return nullptr;
+            found->second.lastUsed = std::chrono::steady_clock::now();
+            return found->second.session;
+        }
+
+        bool remove(const std::string& id) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return sessions.erase(id) > 0;
+        }
+
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return sessions.size();
+        }
+
+        size_t maxSessions() const {
+            return capacity;
+        }
+
+    private:
+        struct Entry {
+            std::shared_ptr<Session> session;
+            std::chrono::steady_clock::time_point lastUsed;
+        };
+
+        const EngineContext& engine;
+        const size_t hashMegabytes;
+        const std::chrono::steady_clock::duration ttl;
+        size_t capacity;
+
+        std::mutex mutex; // guards sessions and random
+        std::map<std::string, Entry> sessions;
+        std::mt19937_64 random;
+
+        void expire() {
+            const auto now = std::chrono::steady_clock::now();
+            for (auto it = sessions.begin(); it != sessions.end(); ) {
+                if (now - it->second.lastUsed > ttl)
+                    it = sessions.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        void evictOldest() {
+            auto oldest = sessions.begin();
+            for (auto it = sessions.begin(); it != sessions.end(); ++it) {
+                if (it->second.lastUsed < oldest->second.lastUsed)
+                    oldest = it;
+            }
+            if (oldest != sessions.end())
+                sessions.erase(oldest);
+        }
+
+        std::string newId() {
+            static const char digits[] = "0123456789abcdef";
+            uint64_t value = random();
+            std::string id;
+            for (int i = 0; i < 16; ++i, value >>= 4)
+                id += digits[value & 15];
+            return id;
+        }
+    };
+}
+
+#endif
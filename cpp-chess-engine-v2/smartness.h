@@ -3,151 +3,375 @@
 
 #include "board.h"
 #include <stdint.h>
-#include <climits>
 #include <iostream>
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <cmath>
 #include "benchmarking.h"
+#include "transposition.h"
+#include "tablebase.h"
 
 namespace smartness {
     using namespace chess;
 
-    struct MinimaxAlphaBeta {
+    // the deepest any iteration goes, leaves room in the UndoStack
+    const int MAX_DEPTH = MAX_PLY / 2;
+
+    /*
+     what every search shares: the transposition table (lockless, see
+     transposition.h) and the options. nothing in here is written during a
+     search, so any number of workers can run against one context
+     */
+    struct EngineContext {
+        TranspositionTable* table;
+        int minDepth;
         int maxDepth;
-        int movesSearched;
+        int threads; // search threads per search, see LazySmp
 
-        std::vector<Move> bestMovesAtDepths;
-        Board* board;
-        Player player;
+        // budgets for think(), 0 for none. with neither it searches every depth up to maxDepth
+        int64_t moveTime; // milliseconds
+        uint64_t nodeLimit;
 
-        MinimaxAlphaBeta(Board* board, Player player, int maxDepth) : board(board), player(player), maxDepth(maxDepth) {
-            
-        }
+        // how long to think on the opponent's time, milliseconds, 0 to not ponder
+        int64_t ponderTime;
+
+        // probed at every node with few enough men, see tablebase.h
+        const tablebase::Tablebases* tablebases;
+
+        EngineContext(TranspositionTable* table = nullptr) : table(table), minDepth(2), maxDepth(7), threads(1), moveTime(0), nodeLimit(0), ponderTime(0), tablebases(nullptr) { }
+    };
 
-        MinimaxAlphaBeta(Board* board, Player player, int maxDepth, const std::vector<Move>& bestMoves) : MinimaxAlphaBeta(board, player, maxDepth) {
-            bestMovesAtDepths = bestMoves;
+    /*
+     how the window tricks are doing, per worker
+     */
+    struct SearchStats {
+        uint64_t nullWindowSearches; // pvs scout searches of the later moves
+        uint64_t researches; // scouts that failed high and were searched again with the full window
+        uint64_t betaCutoffs;
+        uint64_t firstMoveCutoffs; // cutoffs on the first move tried, good ordering makes most of them this
+        uint64_t aspirationFailLows;
+        uint64_t aspirationFailHighs;
+        uint64_t nullMoveCutoffs;
+        uint64_t nullMoveVerifyFails; // null move cutoffs the verification search did not confirm
+        uint64_t reductions; // late moves searched shallower
+        uint64_t reductionResearches; // reduced moves that beat alpha and went back to full depth
+        uint64_t tablebaseHits; // nodes the endgame tables answered
+        uint64_t evaluations; // static scores taken in the quiescence search
+        uint64_t hashProbes;
+        uint64_t hashHits; // probes that found the position
+        uint64_t hashCutoffs; // hits deep enough to end the node
+
+        SearchStats() : nullWindowSearches(0), researches(0), betaCutoffs(0), firstMoveCutoffs(0), aspirationFailLows(0), aspirationFailHighs(0),
+            nullMoveCutoffs(0), nullMoveVerifyFails(0), reductions(0), reductionResearches(0), tablebaseHits(0), evaluations(0),
+            hashProbes(0), hashHits(0), hashCutoffs(0) { }
+
+        SearchStats& operator += (const SearchStats& other) {
+            nullWindowSearches += other.nullWindowSearches;
+            researches += other.researches;
+            betaCutoffs += other.betaCutoffs;
+            firstMoveCutoffs += other.firstMoveCutoffs;
+            aspirationFailLows += other.aspirationFailLows;
+            aspirationFailHighs += other.aspirationFailHighs;
+            nullMoveCutoffs += other.nullMoveCutoffs;
+            nullMoveVerifyFails += other.nullMoveVerifyFails;
+            reductions += other.reductions;
+            reductionResearches += other.reductionResearches;
+            tablebaseHits += other.tablebaseHits;
+            evaluations += other.evaluations;
+            hashProbes += other.hashProbes;
+            hashHits += other.hashHits;
+            hashCutoffs += other.hashCutoffs;
+            return *this;
         }
+    };
 
-        int run(int depth, int alpha, int beta, int color, Move& bestMove) {
-            // return when cutoff depth is hit
-            if (depth >= maxDepth)
-                return board->getScore() * player;
+    // the first root window, half width in centipawns, it doubles on every failure
+    const int ASPIRATION_WINDOW = 25;
+    const int ASPIRATION_MIN_DEPTH = 4;
 
-            const Player curTurn = player * color;
+    // plies left before a null move is tried, and before its cutoffs are verified
+    const int NULL_MOVE_MIN_DEPTH = 3;
+    const int NULL_MOVE_VERIFY_DEPTH = 7;
 
-            Move trash;
-            Move move;
-            MoveIterator iter(board, curTurn);
+    const int LMR_MIN_DEPTH = 3;
 
-            iter.sort(board);
+    /*
+     late move reductions by plies left and move number, nothing for the
+     first few moves and growing with the log of both
+     */
+    struct Reductions {
+        int8_t table[64][64];
 
-            if (movesSearched == depth && bestMovesAtDepths.size() > depth) {
-                move = bestMovesAtDepths[depth];
-            } else {
-                if (!iter.getNext(move))
-                    return board->getScore() * player;
+        Reductions() {
+            for (int d = 0; d < 64; ++d) {
+                for (int m = 0; m < 64; ++m)
+                    table[d][m] = d < LMR_MIN_DEPTH || m < 4 ? 0 : (int8_t) (0.5 + std::log(d) * std::log(m) / 2.0);
             }
+        }
+    };
 
-            if (player == curTurn) {
-                int max = INT_MIN;
+    inline int lateMoveReduction(int remaining, int moveNumber) {
+        static const Reductions reductions;
+        return reductions.table[std::min(remaining, 63)][std::min(moveNumber, 63)];
+    }
 
-                do {
-                    movesSearched++;
-                    move.apply(board);
-                    int score = run(depth + 1, alpha, beta, -color, trash);
-                    move.apply(board);
+    /*
+     quiescence, play out the captures and promotions at a leaf so it is not
+     scored in the middle of an exchange. the side to move may stand pat on
+     the static score instead of capturing, except in check, where every
+     evasion is searched and having none is mate. ply is the distance from
+     the root, for mate scores, every static score taken counts in evaluations
+     */
+    inline int quiesce(Board& board, UndoStack& stack, Player player, int ply, int alpha, int beta, uint64_t& nodes, uint64_t& evaluations) {
+        if (stack.size >= MAX_PLY) {
+            evaluations++;
+            return board.getScore() * player;
+        }
 
-                    if (score > max) {
-                        bestMove = move;
-                        max = score;
-                    }
-                    if (score > alpha) {
-                        alpha = score;
-                    }
-                    if (beta <= alpha)
-                        break ;
-                    
-                } while (iter.getNext(move));
+        StagedMoveIterator iter(&board, player, Move(), true);
+        const bool inCheck = iter.inCheck();
+        iter.capturesOnly = !inCheck;
 
+        int max = -SCORE_INFINITE;
+        if (!inCheck) {
+            evaluations++;
+            max = board.getScore() * player;
+            if (max >= beta)
                 return max;
-            } else {
-                int min = INT_MAX;
-
-                do {
-                    movesSearched++;
-                    move.apply(board);
-                    int score = run(depth + 1, alpha, beta, -color, trash);
-                    move.apply(board);
-
-                    if (score < min) {
-                        bestMove = move;
-                        min = score;
-                    }
-                    if (score < beta) {
-                        beta = score;
-                    }
-                    if (beta <= alpha)
-                        break ;
-                } while (iter.getNext(move));
-
-                return min;
-            }
+            if (max > alpha)
+                alpha = max;
         }
 
-        int run(Move& bestMove) {
-            movesSearched = 0;
-            return run(0, INT_MIN, INT_MAX, 1, bestMove);
+        Move move;
+        while (iter.getNext(move)) {
+            nodes++;
+            stack.make(&board, move);
+            int score = -quiesce(board, stack, -player, ply + 1, -beta, -alpha, nodes, evaluations);
+            stack.unmake(&board);
+
+            if (score > max)
+                max = score;
+            if (score > alpha)
+                alpha = score;
+            if (alpha >= beta)
+                break ;
         }
 
-        // get a vector of all the recommended moves!
-        void getMoveVector(std::vector<Move>& moves) {
-            benchmarking::Benchmark benchmark;
-            //std::cout << "\tcomputing move vector" << std::endl;
-            for (int i = 0; i < maxDepth; ++i) {
-                Move bestMove;
-                
-                //benchmark.push();
-                movesSearched = 0;
-                run(i, INT_MIN, INT_MAX, i % 2 == 0 ? 1 : -1, bestMove);
-                //clock_t timeTook = benchmark.pop();
-                //std::cout << "\t\tdepth: " << i << " time: " << timeTook << " moves: " << movesSearched << std::endl;
-                
-                bestMove.apply(board);
-                moves.push_back(bestMove);
-            }
-
-            for (int i = maxDepth - 1; i >= 0; --i) {
-                moves[i].apply(board);
-            }
-        }
-        
-        
-    };
+        if (inCheck && max == -SCORE_INFINITE)
+            return -(SCORE_MATE - ply);
+        return max;
+    }
 
-    
     /*
-        old implementation!
+     one search, with its own copy of the board, its own undo stack and its
+     own counters. workers never touch each other or the caller's board
      */
-    
-    using namespace chess;
-    int minimax_alphabeta(Board* board, Player player, int depth, int alpha, int beta, int color, Move& bestMove) {
-        if (depth == 0) {
-            return board->getScore() * player;
+    struct SearchWorker {
+        const EngineContext& context;
+        Board rootBoard;
+        Board board;
+        Player player;
+        UndoStack stack;
+
+        int maxDepth;
+        uint64_t movesSearched; // this iteration, also tells when we are still on the old line
+        uint64_t nodes; // every iteration
+        SearchStats stats;
+        MoveHistory history; // killers and history, kept from one iteration to the next
+
+        // the root score of the last completed search, the next one aims its window at it
+        int lastScore;
+        bool haveLastScore;
+
+        /*
+         triangular principal variation table, row ply holds the best line
+         found from that ply on, pvLength[ply] is where the row ends. a node
+         that raises alpha copies its child's row behind its own move, so row
+         0 is the whole line when the search returns
+         */
+        Move pv[MAX_PLY][MAX_PLY];
+        int pvLength[MAX_PLY];
+
+        // the line of the last search, tried first by the next one
+        Move lastLine[MAX_PLY];
+        int lastLineLength;
+
+        // set by whoever owns the worker, a stopped search returns garbage and stores nothing
+        const std::atomic<bool>* stop;
+
+        /*
+         hard limits, microseconds since the worker was made and nodes, 0 for
+         none. checked every 1024 nodes, a search that hits one is aborted
+         and has to be thrown away like a stopped one
+         */
+        benchmarking::Timer timer;
+        int64_t timeLimit;
+        uint64_t nodeLimit;
+        bool aborted;
+
+        SearchWorker(const EngineContext& context, const Board& position, Player player, const std::atomic<bool>* stop = nullptr) : context(context), rootBoard(position), board(position), player(player), maxDepth(0), movesSearched(0), nodes(0), lastScore(0), haveLastScore(false), lastLineLength(0), stop(stop), timeLimit(0), nodeLimit(0), aborted(false) {
         }
 
-        const Player curTurn = player * color;
+        inline bool stopped() {
+            if (aborted)
+                return true;
+            if (stop && stop->load(std::memory_order_relaxed))
+                return aborted = true;
+            if ((timeLimit || nodeLimit) && (nodes & 1023) == 0)
+                aborted = (nodeLimit && nodes >= nodeLimit) || (timeLimit && timer.elapsedMicroseconds() >= timeLimit);
+            return aborted;
+        }
 
-        Move trash;
-        Move move;
-        MoveIterator iter(board, curTurn);
+        SearchWorker(const SearchWorker&) = delete;
+        SearchWorker& operator = (const SearchWorker&) = delete;
+
+        /*
+         negamax with principal variation search, scores are from the point of
+         view of the side to move (player * color). depth is the distance from
+         the root, remaining the plies left to search. the first move gets the
+         full window and the rest a null window that only proves them worse,
+         one that turns out better is searched again properly. quiet moves late
+         in the order are searched shallower first, and outside the principal
+         variation a side that is still above beta after passing is cut off.
+         transpositions are cut off anywhere off the principal variation
+         */
+        int run(int depth, int remaining, int alpha, int beta, int color, Move& bestMove, bool allowNull = true) {
+            const Player curTurn = player * color;
+
+            pvLength[depth] = depth;
+
+            if (stopped())
+                return 0;
+
+            /*
+             with few enough men left the tables know the exact result, a win
+             in n plies scores like a mate found n plies further down. the
+             root still searches so there is a move to play
+             */
+            tablebase::Result known;
+            if (depth > 0 && context.tablebases && board.totalPieces() <= context.tablebases->maxMen() && context.tablebases->probe(board, known)) {
+                stats.tablebaseHits++;
+                const int mateAt = std::min(depth + known.distance, MAX_PLY - 1);
+                return known.outcome > 0 ? SCORE_MATE - mateAt : (known.outcome < 0 ? -(SCORE_MATE - mateAt) : 0);
+            }
+
+            // settle the captures once the cutoff depth is hit
+            if (remaining <= 0)
+                return quiesce(board, stack, curTurn, depth, alpha, beta, nodes, stats.evaluations);
+
+            const int alphaOrig = alpha;
+            const bool pvNode = beta - alpha > 1;
+
+            TranspositionTable* table = context.table;
+            TranspositionTable::Entry entry;
+            Move hashMove;
+            if (table)
+                stats.hashProbes++;
+            if (table && table->probe(board.hash, entry)) {
+                stats.hashHits++;
+                hashMove = entry.move;
+                // not on the principal variation, a cutoff there would end the line at this node
+                if (depth > 0 && !pvNode && entry.depth >= remaining) {
+                    const int score = scoreFromTable(entry.score, depth);
+                    if (entry.bound == BOUND_EXACT) {
+                        stats.hashCutoffs++;
+                        return score;
+                    }
+                    if (entry.bound == BOUND_LOWER && score > alpha)
+                        alpha = score;
+                    else if (entry.bound == BOUND_UPPER && score < beta)
+                        beta = score;
+                    if (alpha >= beta) {
+                        stats.hashCutoffs++;
+                        return score;
+                    }
+                }
+            }
+
+            // the principal variation from the last iteration goes first, then the table move
+            if (movesSearched == (uint64_t) depth && depth < lastLineLength)
+                hashMove = lastLine[depth];
+
+            Move trash;
+            Move move;
+            StagedMoveIterator iter(&board, curTurn, hashMove, false, &history, depth);
+            const bool inCheck = iter.inCheck();
+
+            /*
+             null move: let the other side move twice, if we still beat beta
+             from a shallower search the real moves will too. not in check,
+             not twice in a row, and never with only pawns left where passing
+             could be the best move there is (zugzwang). deep enough cutoffs
+             are verified by a reduced search without the pass
+             */
+            if (allowNull && !pvNode && !inCheck && depth > 0 && remaining >= NULL_MOVE_MIN_DEPTH
+                    && beta < SCORE_MATE_BOUND && board.hasNonPawnMaterial(curTurn) && board.getScore() * curTurn >= beta) {
+                const int reduction = remaining >= 6 ? 3 : 2;
+                board.setTurn(-board.turn);
+                int score = -run(depth + 1, remaining - 1 - reduction, -beta, -beta + 1, -color, trash, false);
+                board.setTurn(-board.turn);
+                if (stopped())
+                    return 0;
+
+                if (score >= beta) {
+                    if (score >= SCORE_MATE_BOUND)
+                        score = beta;
+                    if (remaining < NULL_MOVE_VERIFY_DEPTH) {
+                        stats.nullMoveCutoffs++;
+                        return score;
+                    }
+                    if (run(depth, remaining - reduction, beta - 1, beta, color, trash, false) >= beta) {
+                        stats.nullMoveCutoffs++;
+                        return score;
+                    }
+                    stats.nullMoveVerifyFails++;
+                    if (stopped())
+                        return 0;
+                }
+            }
 
-        iter.sort(board); // improve move ordering
+            // no legal moves, checkmate or stalemate
+            if (!iter.getNext(move))
+                return inCheck ? -(SCORE_MATE - depth) : 0;
+
+            int max = -SCORE_INFINITE;
+            int moveNumber = 0;
+
+            do {
+                moveNumber++;
+                movesSearched++;
+                nodes++;
+                const bool quiet = isQuiet(&board, move);
+                stack.make(&board, move);
+                int score;
+                if (moveNumber == 1) {
+                    score = -run(depth + 1, remaining - 1, -beta, -alpha, -color, trash);
+                } else {
+                    // late quiet moves, unless they give or get out of check
+                    int reduction = 0;
+                    if (quiet && !inCheck && remaining >= LMR_MIN_DEPTH && !board.inCheck(-curTurn))
+                        reduction = std::min(lateMoveReduction(remaining, moveNumber), remaining - 2);
+
+                    stats.nullWindowSearches++;
+                    score = -run(depth + 1, remaining - 1 - reduction, -alpha - 1, -alpha, -color, trash);
+                    if (reduction > 0) {
+                        stats.reductions++;
+                        if (score > alpha) {
+                            stats.reductionResearches++;
+                            score = -run(depth + 1, remaining - 1, -alpha - 1, -alpha, -color, trash);
+                        }
+                    }
+                    if (score > alpha && score < beta) {
+                        stats.researches++;
+                        score = -run(depth + 1, remaining - 1, -beta, -alpha, -color, trash);
+                    }
+                }
+                stack.unmake(&board);
 
-        if (player == curTurn) {
-            int max = INT_MIN;
-            while (iter.getNext(move)) {
-                move.apply(board);
-                int score = minimax_alphabeta(board, player, depth - 1, alpha, beta, -color, trash);
-                move.apply(board);
+                if (stopped())
+                    return 0;
 
                 if (score > max) {
                     bestMove = move;
@@ -155,50 +379,265 @@ namespace smartness {
                 }
                 if (score > alpha) {
                     alpha = score;
+                    pv[depth][depth] = move;
+                    for (int i = depth + 1; i < pvLength[depth + 1]; ++i)
+                        pv[depth][i] = pv[depth + 1][i];
+                    pvLength[depth] = std::max(pvLength[depth + 1], depth + 1);
+                }
+                if (beta <= alpha) {
+                    stats.betaCutoffs++;
+                    if (moveNumber == 1)
+                        stats.firstMoveCutoffs++;
+                    if (quiet)
+                        history.cutoff(&board, move, depth, remaining);
+                    break ;
                 }
-                //if (beta <= alpha) {
-                //    break ;
-                //}
+            } while (iter.getNext(move));
+
+            if (table) {
+                uint8_t bound = max <= alphaOrig ? BOUND_UPPER : (max >= beta ? BOUND_LOWER : BOUND_EXACT);
+                table->store(board.hash, bestMove, scoreToTable(max, depth), remaining, bound);
             }
+
             return max;
-        } else if (color == -1) {
-            int min = INT_MAX;
-            while (iter.getNext(move)) {
-                move.apply(board);
-                int score = minimax_alphabeta(board, player, depth - 1, alpha, beta, -color, trash);
-                move.apply(board);
-
-                if (score < min) {
-                    bestMove = move;
-                    min = score;
+        }
+
+        /*
+         the root of an iteration, in a window around the last score once
+         that is worth anything, widened every time the score falls outside
+         */
+        int searchRoot(Move& bestMove) {
+            int delta = ASPIRATION_WINDOW;
+            int alpha = -SCORE_INFINITE;
+            int beta = SCORE_INFINITE;
+            if (haveLastScore && maxDepth >= ASPIRATION_MIN_DEPTH) {
+                alpha = std::max(lastScore - delta, -SCORE_INFINITE);
+                beta = std::min(lastScore + delta, SCORE_INFINITE);
+            }
+
+            for (;;) {
+                movesSearched = 0;
+                int score = run(0, maxDepth, alpha, beta, 1, bestMove);
+                if (stopped())
+                    return score;
+
+                delta *= 2;
+                if (score <= alpha) {
+                    stats.aspirationFailLows++;
+                    alpha = std::max(score - delta, -SCORE_INFINITE);
+                } else if (score >= beta) {
+                    stats.aspirationFailHighs++;
+                    beta = std::min(score + delta, SCORE_INFINITE);
+                } else {
+                    lastScore = score;
+                    haveLastScore = true;
+                    return score;
                 }
-                if (score < beta)
-                    beta = score;
-                //if (beta <= alpha)
-                //    break;
             }
-            return min;
         }
-        return 0;
-    };
 
-    int minimax_alphabeta(Board* board, Player player, int depth, Move& bestMove) {
-        return minimax_alphabeta(board, player, depth, INT_MIN, INT_MAX, 1, bestMove);
-    };
+        /*
+         search the root position to depth and return the best line, read
+         from the pv table. the line from the previous call is tried first
+         */
+        std::vector<Move> search(int depth) {
+            board = rootBoard;
+            stack = UndoStack();
+            maxDepth = depth;
 
-    void minimax_alphabeta_vector(Board* board, Player player, int depth, std::vector<Move>& moves) {
-        for (int i = 0; i < depth; ++i) {
             Move bestMove;
-            minimax_alphabeta(board, player, depth - i, bestMove);
+            searchRoot(bestMove);
+            if (aborted)
+                return std::vector<Move>();
+
+            std::vector<Move> line(pv[0], pv[0] + pvLength[0]);
+            std::copy(line.begin(), line.end(), lastLine);
+            lastLineLength = (int) line.size();
+            return line;
+        }
 
-            bestMove.apply(board);
-            moves.push_back(bestMove);
+        /*
+         a lazy smp helper, deepen from depth until stopped. nothing comes out
+         of this but the entries it leaves in the table
+         */
+        void help(int depth) {
+            for (; depth <= MAX_DEPTH && !stopped(); ++depth) {
+                Move bestMove;
+                board = rootBoard;
+                stack = UndoStack();
+                maxDepth = depth;
+                movesSearched = 0;
+                run(0, maxDepth, -SCORE_INFINITE, SCORE_INFINITE, 1, bestMove);
+            }
+        }
+    };
+
+    /*
+     lazy smp, context.threads - 1 helpers search the same root as the main
+     worker for as long as it runs, every other helper one ply deeper so they
+     spread out instead of walking the same tree in step. they share results
+     only through the table, the main worker reads them from there and alone
+     decides the move
+     */
+    struct LazySmp {
+        std::atomic<bool> stop;
+        SearchWorker main;
+        std::vector<std::unique_ptr<SearchWorker>> helpers;
+        std::vector<std::thread> threads;
+
+        // cancel, if given, stops the main worker from outside
+        LazySmp(const EngineContext& context, const Board& position, Player player, const std::atomic<bool>* cancel = nullptr) : stop(false), main(context, position, player, cancel) {
+            for (int i = 1; i < context.threads; ++i)
+                helpers.emplace_back(new SearchWorker(context, position, player, &stop));
+            for (size_t i = 0; i < helpers.size(); ++i) {
+                SearchWorker* helper = helpers[i].get();
+                const int depth = context.minDepth + (i % 2 == 0 ? 1 : 0);
+                threads.emplace_back([helper, depth] { helper->help(depth); });
+            }
+        }
+
+        ~LazySmp() {
+            finish();
+        }
+
+        LazySmp(const LazySmp&) = delete;
+        LazySmp& operator = (const LazySmp&) = delete;
+
+        // stop the helpers and wait for them
+        void finish() {
+            stop.store(true, std::memory_order_relaxed);
+            for (auto& thread : threads)
+                thread.join();
+            threads.clear();
+        }
+
+        // every thread's nodes, only meaningful after finish
+        uint64_t nodes() const {
+            uint64_t total = main.nodes;
+            for (auto& helper : helpers)
+                total += helper->nodes;
+            return total;
+        }
+
+        // every thread's counters, only meaningful after finish
+        SearchStats stats() const {
+            SearchStats total = main.stats;
+            for (auto& helper : helpers)
+                total += helper->stats;
+            return total;
         }
+    };
 
-        for (int i = depth - 1; i >= 0; --i) {
-            moves[i].apply(board);
+    struct SearchResult {
+        std::vector<Move> line; // from the deepest completed iteration, empty if there is no legal move
+        int depth;
+        uint64_t nodes; // every thread's once think returns, the main worker's in report
+        int64_t elapsed; // microseconds
+        SearchStats stats; // every thread's once think returns, the main worker's in report
+
+        // every completed iteration, what it cost the main worker on its own
+        struct Iteration {
+            int depth;
+            uint64_t nodes;
+            int64_t elapsed; // microseconds
+        };
+        std::vector<Iteration> iterations;
+
+        /*
+         effective branching factor, how many times the nodes grew from one
+         iteration to the next, averaged over the last two steps since odd
+         and even depths grow at different rates. 0 with too few iterations
+         */
+        double branching() const {
+            const size_t n = iterations.size();
+            if (n < 2 || iterations[n - 2].nodes == 0)
+                return 0;
+            if (n < 3 || iterations[n - 3].nodes == 0)
+                return (double) iterations[n - 1].nodes / iterations[n - 2].nodes;
+            return std::sqrt((double) iterations[n - 1].nodes / iterations[n - 3].nodes);
         }
+    };
+
+    /*
+     iterative deepening under the context's budgets. before every depth it
+     guesses the cost from the effective branching factor of the last
+     iterations and does not start one that will not finish, it also quits
+     early once the best move has held for a few iterations. a depth that
+     hits a hard limit anyway is thrown away, so the result always comes from
+     the deepest completed iteration. report is called after every one.
+     setting cancel ends the search like a budget running out. history, if
+     given, seeds the main worker's killers and history and gets them back
+     afterwards, so a game can carry them from one move to the next
+     */
+    template<class REPORT>
+    SearchResult think(const EngineContext& context, const Board& position, Player player, REPORT report, const std::atomic<bool>* cancel = nullptr, MoveHistory* history = nullptr) {
+        const int64_t budget = context.moveTime * 1000;
+        const int STABLE_ITERATIONS = 3;
+
+        LazySmp search(context, position, player, cancel);
+        SearchWorker& worker = search.main;
+        if (history)
+            worker.history = *history;
+
+        SearchResult result;
+        result.depth = 0;
+        result.nodes = 0;
+        result.elapsed = 0;
+
+        int stable = 0;
+
+        for (int depth = context.minDepth; depth <= context.maxDepth; ++depth) {
+            const int64_t start = worker.timer.elapsedMicroseconds();
+            const uint64_t startNodes = worker.nodes;
+            std::vector<Move> line = worker.search(depth);
+            if (worker.aborted)
+                break ;
+
+            const int64_t spent = worker.timer.elapsedMicroseconds() - start;
+            const uint64_t spentNodes = worker.nodes - startNodes;
+
+            stable = !line.empty() && !result.line.empty() && line[0] == result.line[0] ? stable + 1 : 0;
+            result.line = line;
+            result.depth = depth;
+            result.nodes = worker.nodes;
+            result.stats = worker.stats;
+            result.elapsed = worker.timer.elapsedMicroseconds();
+            result.iterations.push_back(SearchResult::Iteration{depth, spentNodes, spent});
+            report(result);
+
+            // the game is over inside the horizon, looking deeper changes nothing
+            if (line.empty())
+                break ;
+
+            // there is a move now, from here on the budgets are enforced mid search
+            worker.timeLimit = budget;
+            worker.nodeLimit = context.nodeLimit;
+
+            const double branching = std::max(result.branching(), 1.0);
+
+            if (budget) {
+                if (result.elapsed + spent * branching > budget)
+                    break ;
+                if (stable >= STABLE_ITERATIONS && result.elapsed * 4 >= budget)
+                    break ;
+            }
+            if (context.nodeLimit && worker.nodes + spentNodes * branching > context.nodeLimit)
+                break ;
+        }
+
+        // the helpers searched until now, count them and the time they had
+        search.finish();
+        result.nodes = search.nodes();
+        result.stats = search.stats();
+        result.elapsed = worker.timer.elapsedMicroseconds();
+        if (history)
+            *history = worker.history;
+        return result;
+    }
+
+    inline SearchResult think(const EngineContext& context, const Board& position, Player player) {
+        return think(context, position, player, [](const SearchResult&) { });
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,90 @@
+#ifndef __STATISTICS_H_
+#define __STATISTICS_H_
+
+#include "smartness.h"
+#include "benchmarking.h"
+#include <stdint.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace smartness {
+
+    /*
+     totals over every search the engine has run, for the /stats page. the
+     workers count into their own SearchStats without any sharing, the totals
+     here only take a lock once per finished search
+     */
+    class Statistics {
+    public:
+        // per depth only the main worker is counted, the helpers do not iterate in step with it
+        struct Depth {
+            uint64_t iterations; // searches that completed this depth
+            uint64_t nodes;
+            int64_t elapsed; // microseconds spent on this depth alone
+        };
+
+        struct Totals {
+            uint64_t searches;
+            uint64_t bookHits; // moves answered from the opening book, no search
+            uint64_t ponderHits; // searches that ran on the opponent's time and were used
+            uint64_t nodes; // every search thread's
+            int64_t elapsed; // microseconds
+            uint64_t depthSum; // of the deepest completed iteration, for the average
+            double branchingSum; // effective branching factors, for the average
+            uint64_t branchingCount;
+            SearchStats stats;
+            std::vector<Depth> depths; // indexed by depth
+            int64_t uptime; // microseconds, set by snapshot
+        };
+
+        Statistics() {
+            totals = Totals();
+            totals.depths.resize(MAX_DEPTH + 1, Depth{0, 0, 0});
+        }
+
+        void record(const SearchResult& result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            totals.searches++;
+            totals.nodes += result.nodes;
+            totals.elapsed += result.elapsed;
+            totals.depthSum += result.depth;
+            totals.stats += result.stats;
+            const double branching = result.branching();
+            if (branching > 0) {
+                totals.branchingSum += branching;
+                totals.branchingCount++;
+            }
+            for (auto& iteration : result.iterations) {
+                Depth& depth = totals.depths[std::min(iteration.depth, MAX_DEPTH)];
+                depth.iterations++;
+                depth.nodes += iteration.nodes;
+                depth.elapsed += iteration.elapsed;
+            }
+        }
+
+        void bookHit() {
+            std::lock_guard<std::mutex> lock(mutex);
+            totals.bookHits++;
+        }
+
+        void ponderHit() {
+            std::lock_guard<std::mutex> lock(mutex);
+            totals.ponderHits++;
+        }
+
+        Totals snapshot() {
+            std::lock_guard<std::mutex> lock(mutex);
+            Totals copy = totals;
+            copy.uptime = started.elapsedMicroseconds();
+            return copy;
+        }
+
+    private:
+        std::mutex mutex; // guards totals
+        Totals totals;
+        benchmarking::Timer started;
+    };
+}
+
+#endif
@@ -0,0 +1,691 @@
+#ifndef __TABLEBASE_H_
+#define __TABLEBASE_H_
+
+#include "board.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ endgame tablebases for 3 and 4 men: for every position of a material
+ signature ("KQK", "KRKP" ...) and either side to move, one byte saying won,
+ lost or drawn and in how many plies. the board has no castling or en
+ passant, so the pieces and the side to move are the whole position.
+
+ a file is the 8 byte magic followed by the bytes of white to move and then
+ black to move, each indexed as below. a byte v is 0 for a draw, odd for a
+ win in v plies, even for a loss in v - 2 plies (2 is checkmated) and
+ BROKEN for a position that cannot happen or is not the canonical one
+ */
+namespace tablebase {
+    using namespace chess;
+
+    const char MAGIC[8] = {'C', 'H', 'E', 'S', 'S', 'T', 'B', '1'};
+    const uint8_t BROKEN = 0xFF;
+    const int MAX_MEN = 4;
+    const int MAX_DISTANCE = 252; // plies, the encoding runs out after this
+
+    // the order the pieces of one side are listed in, strongest first
+    const char PIECE_LETTERS[] = "QRBNP";
+    const Piece PIECE_TYPES[5] = {PIECE_QUEEN, PIECE_ROOK, PIECE_BISHOP, PIECE_KNIGHT, PIECE_PAWN};
+
+    inline uint8_t encodeWin(int plies) { return (uint8_t) plies; };
+    inline uint8_t encodeLoss(int plies) { return (uint8_t) (plies + 2); };
+
+    /*
+     what a probe found, from the side to move's point of view
+     */
+    struct Result {
+        int outcome; // 1 won, 0 drawn, -1 lost
+        int distance; // plies to mate, 0 for a draw
+
+        static Result decode(uint8_t value) {
+            if (value == 0)
+                return Result{0, 0};
+            if (value & 1)
+                return Result{1, value};
+            return Result{-1, value - 2};
+        }
+    };
+
+    /*
+     a material signature. pieces lists what the index is made of: the white
+     king, the black king, then the white pieces and the black pieces
+     strongest first. white is always the stronger side, a board with the
+     material the other way around is probed with the colors flipped
+     */
+    struct Signature {
+        std::string name;
+        std::vector<Piece> pieces;
+        bool pawns;
+        size_t size; // positions per side to move
+
+        static int rank(char letter) {
+            const char* found = std::strchr(PIECE_LETTERS, letter);
+            return found && letter ? (int) (found - PIECE_LETTERS) : -1;
+        }
+
+        // which side's pieces make the stronger signature: more pieces, then better ones
+        static bool stronger(const std::string& a, const std::string& b) {
+            if (a.size() != b.size())
+                return a.size() > b.size();
+            for (size_t i = 0; i < a.size(); ++i) {
+                if (a[i] != b[i])
+                    return rank(a[i]) < rank(b[i]);
+            }
+            return false;
+        }
+
+        static std::string sortPieces(std::string letters) {
+            std::sort(letters.begin(), letters.end(), [](char a, char b) { return rank(a) < rank(b); });
+            return letters;
+        }
+
+        // "KRKQ" becomes "KQKR", false for anything that is not a signature of 3 or 4 men
+        static bool parse(std::string name, Signature& signature) {
+            std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+            const size_t second = name.find('K', 1);
+            if (name.empty() || name[0] != 'K' || second == std::string::npos)
+                return false;
+            std::string white = sortPieces(name.substr(1, second - 1));
+            std::string black = sortPieces(name.substr(second + 1));
+            for (char c : white + black) {
+                if (rank(c) < 0)
+                    return false;
+            }
+            if (white.size() + black.size() < 1 || white.size() + black.size() > MAX_MEN - 2)
+                return false;
+            if (stronger(black, white))
+                std::swap(white, black);
+
+            signature.name = "K" + white + "K" + black;
+            signature.pieces = {PIECE_KING, -PIECE_KING};
+            signature.pawns = false;
+            for (char c : white)
+                signature.pieces.push_back(PIECE_TYPES[rank(c)]);
+            for (char c : black)
+                signature.pieces.push_back(-PIECE_TYPES[rank(c)]);
+            for (Piece piece : signature.pieces)
+                signature.pawns |= piece == PIECE_PAWN || piece == -PIECE_PAWN;
+
+            signature.size = signature.pawns ? 32 : 10;
+            for (size_t i = 1; i < signature.pieces.size(); ++i)
+                signature.size *= 64;
+            return true;
+        }
+
+        // every signature of 3 and 4 men, weakest first
+        static std::vector<std::string> all() {
+            std::vector<std::string> names;
+            for (int i = 0; i < 5; ++i)
+                names.push_back(std::string("K") + PIECE_LETTERS[i] + "K");
+            for (int i = 0; i < 5; ++i) {
+                for (int j = i; j < 5; ++j) {
+                    names.push_back(std::string("K") + PIECE_LETTERS[i] + PIECE_LETTERS[j] + "K");
+                    names.push_back(std::string("K") + PIECE_LETTERS[i] + "K" + PIECE_LETTERS[j]);
+                }
+            }
+            return names;
+        }
+    };
+
+    /*
+     the index of a position. pawnless tables use all eight symmetries of the
+     board to bring the white king into the a1-d1-d4 triangle (10 squares),
+     tables with pawns only the left-right mirror to bring it onto files a-d
+     (32 squares). the other pieces follow with 6 bits each. of all the
+     symmetric images the smallest index is the canonical one, pieces of the
+     same kind are sorted first, so every position has exactly one index
+     */
+    namespace detail {
+        inline int transform(int square, int symmetry) {
+            int x = square & 7, y = square >> 3;
+            if (symmetry & 1)
+                x = 7 - x;
+            if (symmetry & 2)
+                y = 7 - y;
+            if (symmetry & 4)
+                std::swap(x, y);
+            return x + y * 8;
+        }
+
+        // the king slot of a square, -1 outside the region
+        inline int kingSlot(int square, bool pawns) {
+            const int x = square & 7, y = square >> 3;
+            if (pawns)
+                return x < 4 ? y * 4 + x : -1;
+            if (x > 3 || y > x)
+                return -1;
+            static const int triangle[4][4] = {{0, 1, 2, 3}, {-1, 4, 5, 6}, {-1, -1, 7, 8}, {-1, -1, -1, 9}};
+            return triangle[y][x];
+        }
+
+        inline int slotSquare(int slot, bool pawns) {
+            if (pawns)
+                return (slot / 4) * 8 + slot % 4;
+            static const int squares[10] = {0, 1, 2, 3, 9, 10, 11, 18, 19, 27};
+            return squares[slot];
+        }
+    }
+
+    inline uint64_t encode(const Signature& signature, const int* squares) {
+        const size_t men = signature.pieces.size();
+        uint64_t best = UINT64_MAX;
+        for (int symmetry = 0; symmetry < (signature.pawns ? 2 : 8); ++symmetry) {
+            int moved[MAX_MEN];
+            for (size_t i = 0; i < men; ++i)
+                moved[i] = detail::transform(squares[i], symmetry);
+            const int slot = detail::kingSlot(moved[0], signature.pawns);
+            if (slot < 0)
+                continue ;
+
+            for (size_t i = 2; i < men; ) {
+                size_t end = i + 1;
+                while (end < men && signature.pieces[end] == signature.pieces[i])
+                    end++;
+                std::sort(moved + i, moved + end);
+                i = end;
+            }
+
+            uint64_t index = slot;
+            for (size_t i = 1; i < men; ++i)
+                index = index * 64 + moved[i];
+            best = std::min(best, index);
+        }
+        return best;
+    }
+
+    inline void decode(const Signature& signature, uint64_t index, int* squares) {
+        for (size_t i = signature.pieces.size() - 1; i > 0; --i) {
+            squares[i] = (int) (index % 64);
+            index /= 64;
+        }
+        squares[0] = detail::slotSquare((int) index, signature.pawns);
+    }
+
+    /*
+     the squares of board's pieces in the order of signature, flipped (ranks
+     mirrored and colors swapped) when board has the material the other way
+     around
+     */
+    inline void squaresOf(const Signature& signature, const Board& board, bool flip, int* squares) {
+        Bitboard taken[2][7] = {};
+        for (size_t i = 0; i < signature.pieces.size(); ++i) {
+            const Piece piece = signature.pieces[i];
+            const int color = Board::colorIndex(piece) ^ (flip ? 1 : 0);
+            const int type = piece < 0 ? -piece : piece;
+            const Bitboard left = board.bitboards[color][type] & ~taken[color][type];
+            const int square = bb::lsb(left);
+            taken[color][type] |= bb::square(square);
+            squares[i] = flip ? square ^ 56 : square;
+        }
+    }
+
+    /*
+     the tables found in a directory, mapped read only. safe to probe from
+     any number of threads once open
+     */
+    class Tablebases {
+    public:
+        Tablebases() : men(0), byMaterial(MATERIAL_KEYS) { }
+
+        ~Tablebases() {
+            for (auto& table : tables)
+                munmap(const_cast<uint8_t*>(table->data), table->bytes);
+        }
+
+        Tablebases(const Tablebases&) = delete;
+        Tablebases& operator = (const Tablebases&) = delete;
+
+        // map every table in directory, how many were found
+        size_t open(const std::string& directory) {
+            size_t found = 0;
+            for (auto& name : Signature::all()) {
+                if (openTable(directory, name))
+                    found++;
+            }
+            return found;
+        }
+
+        bool openTable(const std::string& directory, const std::string& name) {
+            Signature signature;
+            if (!Signature::parse(name, signature))
+                return false;
+            const std::string path = directory + "/" + signature.name + ".tb";
+            const size_t bytes = sizeof(MAGIC) + 2 * signature.size;
+
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat info;
+            if (fstat(fd, &info) != 0 || (size_t) info.st_size != bytes) {
+                ::close(fd);
+                return false;
+            }
+            void* memory = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (memory == MAP_FAILED)
+                return false;
+            if (std::memcmp(memory, MAGIC, sizeof(MAGIC)) != 0) {
+                munmap(memory, bytes);
+                return false;
+            }
+            madvise(memory, bytes, MADV_RANDOM);
+
+            std::unique_ptr<Table> table(new Table{signature, static_cast<const uint8_t*>(memory), bytes});
+            add(table.get());
+            tables.push_back(std::move(table));
+            return true;
+        }
+
+        // the most men of any table that is open, boards with more are never found
+        int maxMen() const {
+            return men;
+        }
+
+        size_t size() const {
+            return tables.size();
+        }
+
+        bool has(const std::string& name) const {
+            for (auto& table : tables) {
+                if (table->signature.name == name)
+                    return true;
+            }
+            return false;
+        }
+
+        /*
+         the position for the side to move, false if no table covers it or
+         it does not have one king a side. bare kings are a draw without a table
+         */
+        bool probe(const Board& board, Result& result) const {
+            if (board.pieceCounts[0][PIECE_KING] != 1 || board.pieceCounts[1][PIECE_KING] != 1)
+                return false;
+            if (board.totalPieces() == 2) {
+                result = Result{0, 0};
+                return true;
+            }
+            if (board.totalPieces() > men)
+                return false;
+
+            const size_t key = materialKey(board.pieceCounts[0], board.pieceCounts[1]);
+            if (key >= byMaterial.size() || !byMaterial[key].table)
+                return false;
+            const Entry& entry = byMaterial[key];
+
+            int squares[MAX_MEN];
+            squaresOf(entry.table->signature, board, entry.flip, squares);
+            const uint64_t index = encode(entry.table->signature, squares);
+            const int side = Board::playerIndex(board.turn) ^ (entry.flip ? 1 : 0);
+            const uint8_t value = entry.table->data[sizeof(MAGIC) + side * entry.table->signature.size + index];
+            if (value == BROKEN)
+                return false;
+            result = Result::decode(value);
+            return true;
+        }
+
+    private:
+        struct Table {
+            Signature signature;
+            const uint8_t* data;
+            size_t bytes;
+        };
+
+        struct Entry {
+            const Table* table;
+            bool flip;
+        };
+
+        // every count of queens, rooks, bishops, knights and pawns up to 2, for both sides
+        static const size_t MATERIAL_KEYS = 59049;
+
+        int men;
+        std::vector<std::unique_ptr<Table>> tables;
+        std::vector<Entry> byMaterial;
+
+        static size_t materialKey(const int8_t* white, const int8_t* black) {
+            size_t key = 0;
+            for (int i = 0; i < 5; ++i) {
+                if (white[PIECE_TYPES[i]] > 2 || black[PIECE_TYPES[i]] > 2)
+                    return MATERIAL_KEYS;
+                key = key * 9 + white[PIECE_TYPES[i]] * 3 + black[PIECE_TYPES[i]];
+            }
+            return key;
+        }
+
+        void add(const Table* table) {
+            int8_t counts[2][7] = {};
+            for (Piece piece : table->signature.pieces)
+                counts[Board::colorIndex(piece)][piece < 0 ? -piece : piece]++;
+            // flipped first, so a signature that is its own mirror image is probed as it is
+            byMaterial[materialKey(counts[1], counts[0])] = Entry{table, true};
+            byMaterial[materialKey(counts[0], counts[1])] = Entry{table, false};
+            men = std::max(men, (int) table->signature.pieces.size());
+        }
+    };
+
+    /*
+     writes tables by retrograde analysis. a first pass over every position
+     finds the legal ones, the mates and stalemates, and settles the moves
+     that capture or promote by probing the smaller tables they lead to
+     (which are made first). what is left is worked backwards one ply at a
+     time: the positions that became lost at ply n make every position that
+     can move into them won at n + 1, a position whose last unresolved move
+     turns out to lead to a win for the opponent is lost. predecessors are
+     found by un-moving the pieces of the side that just moved. both passes
+     split the positions over threads, whatever never resolves is a draw
+     */
+    class Generator {
+    public:
+        Generator(const std::string& directory, int threads) : directory(directory), threads(std::max(1, threads)) {
+            tables.open(directory);
+        }
+
+        // generate name and whatever it depends on, skipping tables that are already there
+        void generate(const std::string& name) {
+            Signature signature;
+            if (!Signature::parse(name, signature))
+                throw std::runtime_error("not a tablebase signature: " + name);
+            if (tables.has(signature.name))
+                return ;
+
+            for (auto& dependency : dependencies(signature))
+                generate(dependency);
+            build(signature);
+            if (!tables.openTable(directory, signature.name))
+                throw std::runtime_error("could not open the table just written: " + signature.name);
+        }
+
+    private:
+        const std::string directory;
+        const int threads;
+        Tablebases tables;
+
+        // the signatures a capture or a promotion can lead to
+        static std::vector<std::string> dependencies(const Signature& signature) {
+            std::vector<std::string> found;
+            const std::string& name = signature.name;
+            const size_t second = name.find('K', 1);
+            for (size_t i = 1; i < name.size(); ++i) {
+                if (i == second)
+                    continue ;
+                std::string captured = name;
+                captured.erase(i, 1);
+                if (captured.size() > 2)
+                    found.push_back(captured);
+                if (name[i] == 'P') {
+                    for (int j = 0; j < 4; ++j) {
+                        std::string promoted = name;
+                        promoted[i] = PIECE_LETTERS[j];
+                        found.push_back(promoted);
+                    }
+                }
+            }
+            return found;
+        }
+
+        template<class WORK>
+        void parallel(size_t count, WORK work) {
+            const size_t CHUNK = 4096;
+            std::atomic<size_t> next(0);
+            std::mutex mutex; // guards error
+            std::exception_ptr error;
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    try {
+                        size_t begin;
+                        while ((begin = next.fetch_add(CHUNK)) < count)
+                            work(begin, std::min(count, begin + CHUNK), t);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        error = std::current_exception();
+                        next.store(count);
+                    }
+                });
+            }
+            for (auto& worker : workers)
+                worker.join();
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        struct Work {
+            const Signature& signature;
+            std::unique_ptr<std::atomic<uint8_t>[]> values; // white to move then black to move
+            std::unique_ptr<std::atomic<uint8_t>[]> unresolved; // moves staying in the table that are not yet known to lose
+            std::unique_ptr<uint8_t[]> exitLoss; // the longest loss through captures and promotions, 0 for none, BROKEN if one does not lose
+            std::vector<std::vector<uint32_t>> levels; // positions that resolve at each ply, won at odd plies and lost at even
+            std::mutex mutex; // guards levels while propagating
+
+            Work(const Signature& signature) : signature(signature), values(new std::atomic<uint8_t>[2 * signature.size]()), unresolved(new std::atomic<uint8_t>[2 * signature.size]()), exitLoss(new uint8_t[2 * signature.size]()), levels(MAX_DISTANCE + 1) { }
+
+            void schedule(int level, uint32_t position) {
+                if (level > MAX_DISTANCE)
+                    throw std::runtime_error("mate too long to encode in " + signature.name);
+                std::lock_guard<std::mutex> lock(mutex);
+                levels[level].push_back(position);
+            }
+        };
+
+        static bool setUp(const Signature& signature, const int* squares, Board& board) {
+            Bitboard used = 0;
+            for (size_t i = 0; i < signature.pieces.size(); ++i) {
+                const Bitboard bit = bb::square(squares[i]);
+                const Piece piece = signature.pieces[i];
+                if (used & bit)
+                    return false;
+                if ((piece == PIECE_PAWN || piece == -PIECE_PAWN) && (Board::getY(squares[i]) == 0 || Board::getY(squares[i]) == 7))
+                    return false;
+                used |= bit;
+                board.setPiece(squares[i], piece);
+            }
+            return true;
+        }
+
+        void build(const Signature& signature) {
+            std::cout << "generating " << signature.name << ", " << 2 * signature.size << " positions" << std::endl;
+            Work work(signature);
+            const size_t size = signature.size;
+
+            // first pass: legality, mates, and everything that leaves the table
+            parallel(2 * size, [&](size_t begin, size_t end, int) {
+                std::vector<std::pair<int, uint32_t>> scheduled;
+                for (size_t position = begin; position < end; ++position) {
+                    const Player turn = position < size ? 1 : -1;
+                    const uint64_t index = position % size;
+                    int squares[MAX_MEN];
+                    decode(signature, index, squares);
+
+                    Board board;
+                    if (!setUp(signature, squares, board) || encode(signature, squares) != index || board.inCheck(-turn)) {
+                        work.values[position].store(BROKEN, std::memory_order_relaxed);
+                        continue ;
+                    }
+                    board.setTurn(turn);
+
+                    MoveIterator iter(&board, turn);
+                    if (iter.moveCount == 0) {
+                        if (board.inCheck(turn))
+                            scheduled.push_back(std::make_pair(0, (uint32_t) position));
+                        continue ;
+                    }
+
+                    int exitWin = 0;
+                    int exitLoss = 0;
+                    bool exitDraw = false;
+                    std::vector<uint64_t> children;
+                    Move move;
+                    while (iter.getNext(move)) {
+                        Undo undo;
+                        const bool leaves = move.promotion() || board.pieceAt(move.to()) != PIECE_EMPTY;
+                        board.makeMove(move, undo);
+                        if (leaves) {
+                            Result child;
+                            if (!tables.probe(board, child))
+                                throw std::runtime_error("missing a table " + signature.name + " depends on");
+                            if (child.outcome < 0)
+                                exitWin = exitWin ? std::min(exitWin, child.distance + 1) : child.distance + 1;
+                            else if (child.outcome > 0)
+                                exitLoss = std::max(exitLoss, child.distance + 1);
+                            else
+                                exitDraw = true;
+                        } else {
+                            int next[MAX_MEN];
+                            squaresOf(signature, board, false, next);
+                            children.push_back(encode(signature, next));
+                        }
+                        board.unmakeMove(move, undo);
+                    }
+
+                    std::sort(children.begin(), children.end());
+                    const size_t distinct = std::unique(children.begin(), children.end()) - children.begin();
+                    work.unresolved[position].store((uint8_t) distinct, std::memory_order_relaxed);
+                    work.exitLoss[position] = exitWin || exitDraw ? BROKEN : (uint8_t) exitLoss;
+
+                    if (exitWin)
+                        scheduled.push_back(std::make_pair(exitWin, (uint32_t) position));
+                    else if (distinct == 0 && !exitDraw)
+                        scheduled.push_back(std::make_pair(exitLoss, (uint32_t) position));
+                }
+                for (auto& entry : scheduled)
+                    work.schedule(entry.first, entry.second);
+            });
+
+            // then backwards a ply at a time
+            for (int level = 0; level <= MAX_DISTANCE; ++level) {
+                std::vector<uint32_t> frontier;
+                frontier.swap(work.levels[level]);
+                if (frontier.empty())
+                    continue ;
+
+                const uint8_t value = level & 1 ? encodeWin(level) : encodeLoss(level);
+                parallel(frontier.size(), [&](size_t begin, size_t end, int) {
+                    std::vector<uint32_t> claimed;
+                    for (size_t i = begin; i < end; ++i) {
+                        uint8_t unknown = 0;
+                        if (work.values[frontier[i]].compare_exchange_strong(unknown, value, std::memory_order_relaxed))
+                            claimed.push_back(frontier[i]);
+                    }
+                    for (uint32_t position : claimed)
+                        propagate(work, position, level);
+                });
+            }
+
+            write(signature, work);
+        }
+
+        /*
+         position just resolved at level, tell the positions that move into it
+         */
+        void propagate(Work& work, uint32_t position, int level) {
+            const Signature& signature = work.signature;
+            const size_t size = signature.size;
+            const Player turn = position < size ? 1 : -1;
+            const uint32_t previous = position < size ? (uint32_t) size : 0; // the other side to move
+
+            int squares[MAX_MEN];
+            decode(signature, position % size, squares);
+            Bitboard occupied = 0;
+            for (size_t i = 0; i < signature.pieces.size(); ++i)
+                occupied |= bb::square(squares[i]);
+
+            // every way the side that just moved (-turn) could have got here without a capture or promotion
+            std::vector<uint32_t> predecessors;
+            for (size_t i = 0; i < signature.pieces.size(); ++i) {
+                const Piece piece = signature.pieces[i];
+                if ((piece > 0 ? 1 : -1) != -turn)
+                    continue ;
+                const int square = squares[i];
+
+                Bitboard from = 0;
+                switch (piece < 0 ? -piece : piece) {
+                    case PIECE_KING: from = bb::kingAttacks[square]; break;
+                    case PIECE_KNIGHT: from = bb::knightAttacks[square]; break;
+                    case PIECE_BISHOP: from = bb::bishopAttacks(square, occupied); break;
+                    case PIECE_ROOK: from = bb::rookAttacks(square, occupied); break;
+                    case PIECE_QUEEN: from = bb::queenAttacks(square, occupied); break;
+                    case PIECE_PAWN: {
+                        const int back = piece > 0 ? -8 : 8;
+                        const int y = Board::getY(square);
+                        const bool firstRank = piece > 0 ? y <= 1 : y >= 6;
+                        if (!firstRank && !(occupied & bb::square(square + back))) {
+                            from |= bb::square(square + back);
+                            if ((piece > 0 ? y == 3 : y == 4) && !(occupied & bb::square(square + 2 * back)))
+                                from |= bb::square(square + 2 * back);
+                        }
+                        break;
+                    }
+                }
+                from &= ~occupied;
+
+                while (from) {
+                    int moved[MAX_MEN];
+                    std::copy(squares, squares + signature.pieces.size(), moved);
+                    moved[i] = bb::popLsb(from);
+                    const uint32_t predecessor = previous + (uint32_t) encode(signature, moved);
+                    if (work.values[predecessor].load(std::memory_order_relaxed) != BROKEN)
+                        predecessors.push_back(predecessor);
+                }
+            }
+            std::sort(predecessors.begin(), predecessors.end());
+            predecessors.erase(std::unique(predecessors.begin(), predecessors.end()), predecessors.end());
+
+            for (uint32_t predecessor : predecessors) {
+                if (!(level & 1)) {
+                    // we are lost, so moving here wins
+                    if (work.values[predecessor].load(std::memory_order_relaxed) == 0)
+                        work.schedule(level + 1, predecessor);
+                } else if (work.unresolved[predecessor].fetch_sub(1, std::memory_order_relaxed) == 1) {
+                    // we win, and that was the last move that might not have lost
+                    const uint8_t exitLoss = work.exitLoss[predecessor];
+                    if (exitLoss != BROKEN)
+                        work.schedule(std::max(level + 1, (int) exitLoss), predecessor);
+                }
+            }
+        }
+
+        void write(const Signature& signature, Work& work) {
+            const std::string path = directory + "/" + signature.name + ".tb";
+            FILE* out = fopen(path.c_str(), "wb");
+            if (!out)
+                throw std::runtime_error("could not write " + path);
+
+            size_t won = 0, lost = 0, drawn = 0;
+            int longest = 0;
+            std::vector<uint8_t> values(2 * signature.size);
+            for (size_t i = 0; i < values.size(); ++i) {
+                values[i] = work.values[i].load(std::memory_order_relaxed);
+                if (values[i] == BROKEN)
+                    continue ;
+                const Result result = Result::decode(values[i]);
+                (result.outcome > 0 ? won : (result.outcome < 0 ? lost : drawn))++;
+                longest = std::max(longest, result.distance);
+            }
+            const bool written = fwrite(MAGIC, 1, sizeof(MAGIC), out) == sizeof(MAGIC)
+                && fwrite(values.data(), 1, values.size(), out) == values.size();
+            if (fclose(out) != 0 || !written)
+                throw std::runtime_error("could not write " + path);
+
+            std::cout << "\t" << signature.name << ": won " << won << " lost " << lost << " drawn " << drawn
+                << ", longest mate " << longest << " plies" << std::endl;
+        }
+    };
+}
+
+#endif
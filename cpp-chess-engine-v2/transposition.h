@@ -0,0 +1,199 @@
+#ifndef __TRANSPOSITION_H_
+#define __TRANSPOSITION_H_
+
+#include "board.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <climits>
+#include <atomic>
+#include <new>
+
+namespace smartness {
+    using namespace chess;
+
+    const int SCORE_INFINITE = 32000;
+
+    /*
+     being mated at ply n scores -(SCORE_MATE - n), so shorter mates score higher
+     */
+    const int SCORE_MATE = 31000;
+    const int SCORE_MATE_BOUND = SCORE_MATE - MAX_PLY;
+
+    /*
+     the table keeps mate scores relative to the node rather than the root,
+     so they stay right when the position turns up at another ply
+     */
+    inline int scoreToTable(int score, int ply) {
+        if (score >= SCORE_MATE_BOUND)
+            return score + ply;
+        if (score <= -SCORE_MATE_BOUND)
+            return score - ply;
+        return score;
+    }
+
+    inline int scoreFromTable(int score, int ply) {
+        if (score >= SCORE_MATE_BOUND)
+            return score - ply;
+        if (score <= -SCORE_MATE_BOUND)
+            return score + ply;
+        return score;
+    }
+
+    const uint8_t BOUND_NONE = 0;
+    const uint8_t BOUND_UPPER = 1; // score <= the stored value
+    const uint8_t BOUND_LOWER = 2; // score >= the stored value
+    const uint8_t BOUND_EXACT = 3;
+
+    /*
+     a shared hash table of search results. every entry is two 64 bit words,
+     the data and the key xor'd with the data, so a torn write from another
+     thread just fails verification and reads as a miss. no locks anywhere.
+     */
+    class TranspositionTable {
+    public:
+        struct Entry {
+            Move move;
+            int16_t score;
+            uint8_t depth;
+            uint8_t bound;
+        };
+
+    private:
+        struct Slot {
+            std::atomic<uint64_t> check; // key ^ data
+            std::atomic<uint64_t> data;
+        };
+
+        // four slots share a 64 byte cache line
+        static const int BUCKET_SLOTS = 4;
+        struct Bucket {
+            Slot slots[BUCKET_SLOTS];
+        };
+
+        Bucket* buckets;
+        uint64_t mask;
+        std::atomic<uint8_t> age;
+
+        /*
+         data layout: move 0-15, score 16-31, depth 32-39, bound 40-41, age 48-55
+         */
+        inline static uint64_t pack(Move move, int score, int depth, uint8_t bound, uint8_t age) {
+            return (uint64_t) move.data
+                | ((uint64_t) (uint16_t) (int16_t) score << 16)
+                | ((uint64_t) (uint8_t) depth << 32)
+                | ((uint64_t) bound << 40)
+                | ((uint64_t) age << 48);
+        }
+
+        inline static uint8_t ageOf(uint64_t data) { return (uint8_t) (data >> 48); };
+        inline static int depthOf(uint64_t data) { return (uint8_t) (data >> 32); };
+
+    public:
+        TranspositionTable() : buckets(nullptr), mask(0), age(0) { }
+
+        ~TranspositionTable() {
+            free(buckets);
+        }
+
+        TranspositionTable(const TranspositionTable&) = delete;
+        TranspositionTable& operator = (const TranspositionTable&) = delete;
+
+        /*
+         size the table, rounded down to a power of two number of buckets.
+         not thread safe, call it before any search starts
+         */
+        void resize(size_t megabytes) {
+            free(buckets);
+            buckets = nullptr;
+            mask = 0;
+
+            size_t count = 1;
+            while (count * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024)
+                count *= 2;
+
+            void* memory = nullptr;
+            if (posix_memalign(&memory, 64, count * sizeof(Bucket)) != 0)
+                throw std::bad_alloc();
+            buckets = static_cast<Bucket*>(memory);
+            mask = count - 1;
+            for (size_t i = 0; i < count; ++i)
+                new (&buckets[i]) Bucket();
+            clear();
+        }
+
+        void clear() {
+            for (uint64_t i = 0; i <= mask && buckets; ++i) {
+                for (int j = 0; j < BUCKET_SLOTS; ++j) {
+                    buckets[i].slots[j].check.store(0, std::memory_order_relaxed);
+                    buckets[i].slots[j].data.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        size_t sizeInBytes() const {
+            return buckets ? (mask + 1) * sizeof(Bucket) : 0;
+        }
+
+        // entries from earlier searches lose priority for replacement
+        void newSearch() {
+            age.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        bool probe(uint64_t key, Entry& entry) const {
+            if (!buckets)
+                return false;
+            const Bucket& bucket = buckets[key & mask];
+            for (int i = 0; i < BUCKET_SLOTS; ++i) {
+                uint64_t data = bucket.slots[i].data.load(std::memory_order_relaxed);
+                uint64_t check = bucket.slots[i].check.load(std::memory_order_relaxed);
+                if ((check ^ data) == key && data != 0) {
+                    entry.move.data = (uint16_t) data;
+                    entry.score = (int16_t) (data >> 16);
+                    entry.depth = (uint8_t) (data >> 32);
+                    entry.bound = (uint8_t) ((data >> 40) & 3);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void store(uint64_t key, Move move, int score, int depth, uint8_t bound) {
+            if (!buckets)
+                return ;
+            const uint8_t currentAge = age.load(std::memory_order_relaxed);
+            Bucket& bucket = buckets[key & mask];
+
+            /*
+             reuse the slot holding this position, otherwise evict the slot with
+             the least value where every search of age costs 8 plies of depth
+             */
+            Slot* victim = nullptr;
+            int victimValue = INT_MAX;
+            for (int i = 0; i < BUCKET_SLOTS; ++i) {
+                Slot& slot = bucket.slots[i];
+                uint64_t data = slot.data.load(std::memory_order_relaxed);
+                uint64_t check = slot.check.load(std::memory_order_relaxed);
+                if ((check ^ data) == key) {
+                    // keep a deeper result of the current search unless this one is exact
+                    if (ageOf(data) == currentAge && depthOf(data) > depth && bound != BOUND_EXACT)
+                        return ;
+                    if (move.isNull())
+                        move.data = (uint16_t) data;
+                    victim = &slot;
+                    break ;
+                }
+                int value = depthOf(data) - 8 * (uint8_t) (currentAge - ageOf(data));
+                if (value < victimValue) {
+                    victimValue = value;
+                    victim = &slot;
+                }
+            }
+
+            uint64_t data = pack(move, score, depth, bound, currentAge);
+            victim->data.store(data, std::memory_order_relaxed);
+            victim->check.store(key ^ data, std::memory_order_relaxed);
+        }
+    };
+}
+
+#endif
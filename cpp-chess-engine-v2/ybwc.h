@@ -0,0 +1,387 @@
+#ifndef __YBWC_H_
+#define __YBWC_H_
+
+#include "board.h"
+#include "transposition.h"
+#include "smartness.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <climits>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+/*
+ young brothers wait: a node searches its first move alone, then hands the
+ rest of its moves out as tasks. every thread owns a deque of tasks, it works
+ the newest end of its own and steals from the oldest end of the others
+ */
+namespace smartness {
+namespace ybwc {
+    using namespace chess;
+
+    // nodes with fewer plies left than this are searched by one thread
+    const int MIN_SPLIT_DEPTH = 3;
+
+    // how many tasks a thread may nest while it waits on its own split points
+    const int MAX_HELP_DEPTH = 8;
+
+    /*
+     a node whose younger brothers are being searched in parallel. it lives on
+     the stack of the thread that split, which waits until pending is zero.
+     a brother that fails high sets cutoffIndex, every task after it is no
+     longer needed (in the normal search every task at all)
+     */
+    struct SplitPoint {
+        const SplitPoint* parent;
+        int parentIndex; // the task of parent this node is under
+        Board board;
+        Player player; // to move at the split point
+        int depth;
+        int maxDepth;
+        int beta;
+        std::atomic<int> alpha;
+        std::atomic<int> pending;
+        std::atomic<int> cutoffIndex; // INT_MAX until a brother fails high
+
+        std::mutex mutex; // guards everything below
+        int best;
+        Move bestMove;
+        int bestIndex;
+        std::vector<int> scores; // by task index, merged in order in deterministic mode
+        std::vector<uint64_t> nodes; // by task index, what the finished tasks searched
+
+        SplitPoint(const SplitPoint* parent, int parentIndex, const Board& board, Player player, int depth, int maxDepth, int alpha, int beta, int best, Move bestMove, size_t tasks) : parent(parent), parentIndex(parentIndex), board(board), player(player), depth(depth), maxDepth(maxDepth), beta(beta), alpha(alpha), pending(0), cutoffIndex(INT_MAX), best(best), bestMove(bestMove), bestIndex(0), scores(tasks + 1, 0), nodes(tasks + 1, 0) {
+        }
+
+        // a cutoff before task index here, or before the task we are under at any split point above, makes it useless
+        static inline bool cancelled(const SplitPoint* sp, int index) {
+            for (; sp; index = sp->parentIndex, sp = sp->parent) {
+                if (index > sp->cutoffIndex.load(std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
+        }
+
+        // only tasks up to index are needed any more
+        void cutOffAfter(int index) {
+            int current = cutoffIndex.load(std::memory_order_relaxed);
+            while (index < current && !cutoffIndex.compare_exchange_weak(current, index, std::memory_order_relaxed))
+                ;
+        }
+    };
+
+    struct Task {
+        SplitPoint* splitPoint;
+        Move move;
+        int index; // position in the move order, the eldest brother is 0
+        int alpha; // the window when the task was made, used in deterministic mode
+    };
+
+    class Search {
+    public:
+        /*
+         deterministic mode searches without the table, gives every task the
+         window of its split point as it was after the eldest brother, and
+         replays cutoffs in move order: a brother that fails high cancels only
+         the brothers after it, and the results are merged by index as one
+         thread would have met them. the score, the move and treeNodes are
+         the same on any number of threads. without the table the tree is
+         bigger than the normal search's, the two are not comparable
+         */
+        Search(const EngineContext& context, int threadCount, bool deterministic) : table(deterministic ? nullptr : context.table), deterministic(deterministic), quit(false), treeNodeCount(0) {
+            for (int i = 0; i < std::max(1, threadCount); ++i)
+                workers.emplace_back(newWorker());
+            for (size_t i = 1; i < workers.size(); ++i)
+                threads.emplace_back([this, i] { idle(*workers[i]); });
+        }
+
+        ~Search() {
+            quit.store(true, std::memory_order_relaxed);
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        Search(const Search&) = delete;
+        Search& operator = (const Search&) = delete;
+
+        /*
+         search position to depth on the calling thread and whoever steals
+         from it, the score is from the point of view of player
+         */
+        int run(const Board& position, Player player, int depth, Move& bestMove) {
+            Board board = position;
+            UndoStack stack;
+            bestMove = Move();
+            uint64_t nodes = 0;
+            const int score = negamax(*workers[0], board, stack, player, 0, depth, -SCORE_INFINITE, SCORE_INFINITE, nullptr, 0, bestMove, nodes);
+            treeNodeCount += nodes;
+            return score;
+        }
+
+        /*
+         counters summed over every thread, read them between searches
+         */
+        uint64_t nodes() const { return sum(&Worker::nodes); };
+        uint64_t treeNodes() const { return treeNodeCount; }; // without the tasks a cutoff made useless
+        uint64_t evaluations() const { return sum(&Worker::evaluations); };
+        uint64_t splits() const { return sum(&Worker::splits); };
+        uint64_t steals() const { return sum(&Worker::steals); };
+        uint64_t cancelledTasks() const { return sum(&Worker::cancelled); };
+
+    private:
+        struct alignas(64) Worker {
+            std::mutex mutex; // guards tasks
+            std::deque<Task> tasks;
+            int helpDepth;
+            uint64_t nodes;
+            uint64_t evaluations;
+            uint64_t splits;
+            uint64_t steals;
+            uint64_t cancelled;
+
+            Worker() : helpDepth(0), nodes(0), evaluations(0), splits(0), steals(0), cancelled(0) { }
+        };
+
+        // plain new ignores alignas before c++17, the workers are allocated aligned like the table buckets
+        struct WorkerDeleter {
+            void operator () (Worker* worker) const {
+                worker->~Worker();
+                free(worker);
+            }
+        };
+
+        static Worker* newWorker() {
+            void* memory = nullptr;
+            if (posix_memalign(&memory, alignof(Worker), sizeof(Worker)) != 0)
+                throw std::bad_alloc();
+            return new (memory) Worker();
+        }
+
+        TranspositionTable* table;
+        const bool deterministic;
+        std::atomic<bool> quit;
+        uint64_t treeNodeCount;
+        std::vector<std::unique_ptr<Worker, WorkerDeleter>> workers;
+        std::vector<std::thread> threads;
+
+        uint64_t sum(uint64_t Worker::* counter) const {
+            uint64_t total = 0;
+            for (auto& worker : workers)
+                total += (*worker).*counter;
+            return total;
+        }
+
+        /*
+         parent and parentIndex are the task this node is under, nodes counts
+         the tree below it including the tasks that were needed
+         */
+        int negamax(Worker& worker, Board& board, UndoStack& stack, Player player, int depth, int maxDepth, int alpha, int beta, const SplitPoint* parent, int parentIndex, Move& bestMove, uint64_t& nodes) {
+            worker.nodes++;
+            nodes++;
+            if (SplitPoint::cancelled(parent, parentIndex))
+                return 0;
+
+            if (depth >= maxDepth) {
+                const uint64_t before = nodes;
+                const int score = quiesce(board, stack, player, depth, alpha, beta, nodes, worker.evaluations);
+                worker.nodes += nodes - before;
+                return score;
+            }
+
+            const int remaining = maxDepth - depth;
+            const int alphaOrig = alpha;
+
+            TranspositionTable::Entry entry;
+            Move hashMove;
+            if (table && table->probe(board.hash, entry)) {
+                hashMove = entry.move;
+                if (depth > 0 && entry.depth >= remaining) {
+                    const int score = scoreFromTable(entry.score, depth);
+                    if (entry.bound == BOUND_EXACT)
+                        return score;
+                    if (entry.bound == BOUND_LOWER && score > alpha)
+                        alpha = score;
+                    else if (entry.bound == BOUND_UPPER && score < beta)
+                        beta = score;
+                    if (alpha >= beta)
+                        return score;
+                }
+            }
+
+            Move trash;
+            Move move;
+            StagedMoveIterator iter(&board, player, hashMove);
+
+            // no legal moves, checkmate or stalemate
+            if (!iter.getNext(move))
+                return iter.inCheck() ? -(SCORE_MATE - depth) : 0;
+
+            // the eldest brother is always searched alone
+            stack.make(&board, move);
+            int max = -negamax(worker, board, stack, -player, depth + 1, maxDepth, -beta, -alpha, parent, parentIndex, trash, nodes);
+            stack.unmake(&board);
+            if (SplitPoint::cancelled(parent, parentIndex))
+                return 0;
+            bestMove = move;
+            if (max > alpha)
+                alpha = max;
+
+            if (alpha < beta && remaining >= MIN_SPLIT_DEPTH) {
+                std::vector<Move> brothers;
+                while (iter.getNext(move))
+                    brothers.push_back(move);
+                if (!brothers.empty())
+                    max = split(worker, board, player, depth, maxDepth, alpha, beta, parent, parentIndex, brothers, max, bestMove, nodes);
+            } else {
+                while (alpha < beta && iter.getNext(move)) {
+                    stack.make(&board, move);
+                    int score = -negamax(worker, board, stack, -player, depth + 1, maxDepth, -beta, -alpha, parent, parentIndex, trash, nodes);
+                    stack.unmake(&board);
+                    if (SplitPoint::cancelled(parent, parentIndex))
+                        return 0;
+
+                    if (score > max) {
+                        bestMove = move;
+                        max = score;
+                    }
+                    if (score > alpha)
+                        alpha = score;
+                }
+            }
+
+            if (SplitPoint::cancelled(parent, parentIndex))
+                return 0;
+
+            if (table) {
+                uint8_t bound = max <= alphaOrig ? BOUND_UPPER : (max >= beta ? BOUND_LOWER : BOUND_EXACT);
+                table->store(board.hash, bestMove, scoreToTable(max, depth), remaining, bound);
+            }
+            return max;
+        }
+
+        /*
+         queue the younger brothers on our own deque, then work on them (or on
+         anything we can steal) until they are all done
+         */
+        int split(Worker& worker, Board& board, Player player, int depth, int maxDepth, int alpha, int beta, const SplitPoint* parent, int parentIndex, const std::vector<Move>& brothers, int best, Move& bestMove, uint64_t& nodes) {
+            SplitPoint sp(parent, parentIndex, board, player, depth, maxDepth, alpha, beta, best, bestMove, brothers.size());
+            sp.pending.store((int) brothers.size(), std::memory_order_relaxed);
+            worker.splits++;
+
+            {
+                // the first brother ends up at the back, where we pop from
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                for (int i = (int) brothers.size() - 1; i >= 0; --i)
+                    worker.tasks.push_back(Task{&sp, brothers[i], i + 1, alpha});
+            }
+
+            while (sp.pending.load(std::memory_order_acquire) > 0) {
+                Task task;
+                if (popOwn(worker, &sp, task)) {
+                    execute(worker, task);
+                } else if (worker.helpDepth < MAX_HELP_DEPTH && steal(worker, task)) {
+                    worker.steals++;
+                    execute(worker, task);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+
+            // every task has finished or given up, nobody else touches sp now
+            const int last = std::min(sp.cutoffIndex.load(std::memory_order_relaxed), (int) brothers.size());
+            if (deterministic) {
+                for (int i = 1; i <= last; ++i) {
+                    nodes += sp.nodes[i];
+                    if (sp.scores[i] > best) {
+                        best = sp.scores[i];
+                        bestMove = brothers[i - 1];
+                    }
+                }
+                return best;
+            }
+            for (size_t i = 1; i < sp.nodes.size(); ++i)
+                nodes += sp.nodes[i];
+            bestMove = sp.bestMove;
+            return sp.best;
+        }
+
+        void execute(Worker& worker, const Task& task) {
+            SplitPoint& sp = *task.splitPoint;
+            if (SplitPoint::cancelled(&sp, task.index)) {
+                worker.cancelled++;
+            } else {
+                Board board = sp.board;
+                UndoStack stack;
+                Move trash;
+                uint64_t nodes = 0;
+                const int alpha = deterministic ? task.alpha : sp.alpha.load(std::memory_order_relaxed);
+
+                worker.helpDepth++;
+                stack.make(&board, task.move);
+                const int score = -negamax(worker, board, stack, -sp.player, sp.depth + 1, sp.maxDepth, -sp.beta, -alpha, &sp, task.index, trash, nodes);
+                worker.helpDepth--;
+
+                if (!SplitPoint::cancelled(&sp, task.index)) {
+                    std::lock_guard<std::mutex> lock(sp.mutex);
+                    sp.scores[task.index] = score;
+                    sp.nodes[task.index] = nodes;
+                    if (score > sp.best || (score == sp.best && task.index < sp.bestIndex)) {
+                        sp.best = score;
+                        sp.bestMove = task.move;
+                        sp.bestIndex = task.index;
+                    }
+                    if (score > sp.alpha.load(std::memory_order_relaxed))
+                        sp.alpha.store(score, std::memory_order_relaxed);
+                    if (score >= sp.beta)
+                        sp.cutOffAfter(deterministic ? task.index : 0);
+                }
+            }
+            sp.pending.fetch_sub(1, std::memory_order_release);
+        }
+
+        // the newest task on our own deque, but only if it belongs to sp
+        bool popOwn(Worker& worker, SplitPoint* sp, Task& task) {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty() || worker.tasks.back().splitPoint != sp)
+                return false;
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
+            return true;
+        }
+
+        // the oldest task of anybody else
+        bool steal(Worker& worker, Task& task) {
+            for (auto& victim : workers) {
+                if (victim.get() == &worker)
+                    continue ;
+                std::lock_guard<std::mutex> lock(victim->mutex);
+                if (!victim->tasks.empty()) {
+                    task = victim->tasks.front();
+                    victim->tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void idle(Worker& worker) {
+            while (!quit.load(std::memory_order_relaxed)) {
+                Task task;
+                if (steal(worker, task)) {
+                    worker.steals++;
+                    execute(worker, task);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    };
+}
+}
+
+#endif